@@ -873,6 +873,10 @@ void boot_linux(void *kernel, unsigned *tags,
 	}
 #endif
 
+#if LK2ND_BOOT_HISTORY
+	lk2nd_boot_history_save();
+#endif
+
 	/* Perform target specific cleanup */
 	target_uninit();
 
@@ -1188,6 +1192,10 @@ int boot_linux_from_mmc(void)
 		}
 	}
 
+#if LK2ND_BOOT_HISTORY
+	lk2nd_boot_history_set_source(boot_into_recovery ? "recovery" : "boot");
+#endif
+
 	if (mmc_read(ptn + offset, (unsigned int *) buf, page_size)) {
 		dprintf(CRITICAL, "ERROR: Cannot read boot image header\n");
                 return -1;
@@ -2370,6 +2378,12 @@ void cmd_boot(const char *arg, void *data, unsigned sz)
 		return;
 	}
 
+#if LK2ND_BOOT_HISTORY
+	/* fs-boot passes no argument and has already set the source */
+	if (arg)
+		lk2nd_boot_history_set_source("fastboot");
+#endif
+
 	hdr = (struct boot_img_hdr *)data;
 
 	/* ensure commandline is terminated */
@@ -2634,6 +2648,9 @@ void cmd_erase_mmc(const char *arg, void *data, unsigned sz)
 
 void cmd_erase(const char *arg, void *data, unsigned sz)
 {
+	/* The contents change, probe all partitions again for fs-boot */
+	fsboot_probe_reset();
+
 #if CHECK_BAT_VOLTAGE
 	if (!target_battery_soc_ok()) {
 		fastboot_fail("Warning: battery's capacity is very low\n");
@@ -2835,6 +2852,45 @@ void cmd_flash_meta_img(const char *arg, void *data, unsigned sz)
 #endif
 }
 
+/* Maximum size of the buffer used to write CHUNK_TYPE_FILL */
+#define SPARSE_FILL_BUF_SIZE	(64 * 1024)
+
+/*
+ * Small sparse chunks are batched with mmc_write_queued() on eMMC with the
+ * SDHCI driver, everything else writes each chunk immediately.
+ */
+#if !MMC_SDHCI_SUPPORT
+struct mmc_write_queue {
+	uint32_t count;
+};
+#endif
+
+static void sparse_write_init(struct mmc_write_queue *queue)
+{
+#if MMC_SDHCI_SUPPORT
+	mmc_write_queue_init(queue);
+#endif
+}
+
+static uint32_t sparse_write(struct mmc_write_queue *queue, uint64_t data_addr,
+			     uint32_t data_len, void *in)
+{
+#if MMC_SDHCI_SUPPORT
+	if (target_is_emmc_boot())
+		return mmc_write_queued(queue, data_addr, data_len, in);
+#endif
+	return mmc_write(data_addr, data_len, in);
+}
+
+static uint32_t sparse_write_flush(struct mmc_write_queue *queue)
+{
+#if MMC_SDHCI_SUPPORT
+	if (target_is_emmc_boot())
+		return mmc_write_queue_flush(queue);
+#endif
+	return 0;
+}
+
 void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 {
 	unsigned int chunk;
@@ -2842,7 +2898,10 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 	uint32_t *fill_buf = NULL;
 	uint32_t fill_val;
 	uint32_t chunk_blk_cnt = 0;
+	uint32_t fill_blk_cnt = 0;
+	uint32_t fill_buf_sz = 0;
 	uint32_t blk_sz_actual = 0;
+	struct mmc_write_queue write_queue;
 	sparse_header_t *sparse_header;
 	chunk_header_t *chunk_header;
 	uint32_t total_blocks = 0;
@@ -2907,13 +2966,19 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 	dprintf (SPEW, "total_blks: %d\n", sparse_header->total_blks);
 	dprintf (SPEW, "total_chunks: %d\n", sparse_header->total_chunks);
 
+	/*
+	 * Small RAW/FILL chunks are queued and written in batches to avoid
+	 * paying the command overhead for each of them separately.
+	 */
+	sparse_write_init(&write_queue);
+
 	/* Start processing chunks */
 	for (chunk=0; chunk<sparse_header->total_chunks; chunk++)
 	{
 		/* Make sure the total image size does not exceed the partition size */
 		if(((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz) >= size) {
 			fastboot_fail("size too large");
-			return;
+			goto out_flush;
 		}
 		/* Read and skip over chunk header */
 		chunk_header = (chunk_header_t *) data;
@@ -2921,7 +2986,7 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 
 		if (data_end < (uint32_t)data) {
 			fastboot_fail("buffer overreads occured due to invalid sparse header");
-			return;
+			goto out_flush;
 		}
 
 		dprintf (SPEW, "=== Chunk Header ===\n");
@@ -2932,7 +2997,7 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 		if(sparse_header->chunk_hdr_sz != sizeof(chunk_header_t))
 		{
 			fastboot_fail("chunk header size mismatch");
-			return;
+			goto out_flush;
 		}
 
 		chunk_data_sz = sparse_header->blk_sz * chunk_header->chunk_sz;
@@ -2944,7 +3009,7 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 			if (sparse_header->blk_sz && (chunk_header->chunk_sz != chunk_data_sz / sparse_header->blk_sz))
 			{
 			  fastboot_fail("Bogus size sparse and chunk header");
-			  return;
+			  goto out_flush;
 			}
 
 			/* Make sure that the chunk size calculated from sparse image does not
@@ -2953,31 +3018,32 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 			if ((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz + chunk_data_sz > size)
 			{
 			  fastboot_fail("Chunk data size exceeds partition size");
-			  return;
+			  goto out_flush;
 			}
 
 			if(chunk_header->total_sz != (sparse_header->chunk_hdr_sz +
 											chunk_data_sz))
 			{
 				fastboot_fail("Bogus chunk size for chunk type Raw");
-				return;
+				goto out_flush;
 			}
 
 			if (data_end < (uint32_t)data + chunk_data_sz) {
 				fastboot_fail("buffer overreads occured due to invalid sparse header");
-				return;
+				goto out_flush;
 			}
 
-			if(mmc_write(ptn + ((uint64_t)total_blocks*sparse_header->blk_sz),
+			if(sparse_write(&write_queue,
+						ptn + ((uint64_t)total_blocks*sparse_header->blk_sz),
 						chunk_data_sz,
 						(unsigned int*)data))
 			{
 				fastboot_fail("flash write failure");
-				return;
+				goto out_flush;
 			}
 			if(total_blocks > (UINT_MAX - chunk_header->chunk_sz)) {
 				fastboot_fail("Bogus size for RAW chunk type");
-				return;
+				goto out_flush;
 			}
 			total_blocks += chunk_header->chunk_sz;
 			data += chunk_data_sz;
@@ -2988,7 +3054,7 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 											sizeof(uint32_t)))
 			{
 				fastboot_fail("Bogus chunk size for chunk type FILL");
-				return;
+				goto out_flush;
 			}
 
 			blk_sz_actual = ROUNDUP(sparse_header->blk_sz, CACHE_LINE);
@@ -2996,26 +3062,29 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 			if (blk_sz_actual < sparse_header->blk_sz)
 			{
 				fastboot_fail("Invalid block size");
-				return;
+				goto out_flush;
 			}
 
-			fill_buf = (uint32_t *)memalign(CACHE_LINE, blk_sz_actual);
+			/* Fill several blocks at once, limited to a reasonable buffer size */
+			chunk_blk_cnt = chunk_data_sz / sparse_header->blk_sz;
+			fill_blk_cnt = MAX(1, MIN(chunk_blk_cnt, SPARSE_FILL_BUF_SIZE / sparse_header->blk_sz));
+			fill_buf_sz = ROUNDUP(fill_blk_cnt * sparse_header->blk_sz, CACHE_LINE);
+
+			fill_buf = (uint32_t *)memalign(CACHE_LINE, fill_buf_sz);
 			if (!fill_buf)
 			{
 				fastboot_fail("Malloc failed for: CHUNK_TYPE_FILL");
-				return;
+				goto out_flush;
 			}
 
 			if (data_end < (uint32_t)data + sizeof(uint32_t)) {
 				fastboot_fail("buffer overreads occured due to invalid sparse header");
-				free(fill_buf);
-				return;
+				goto out_flush;
 			}
 			fill_val = *(uint32_t *)data;
 			data = (char *) data + sizeof(uint32_t);
-			chunk_blk_cnt = chunk_data_sz / sparse_header->blk_sz;
 
-			for (i = 0; i < (sparse_header->blk_sz / sizeof(fill_val)); i++)
+			for (i = 0; i < (fill_blk_cnt * sparse_header->blk_sz / sizeof(fill_val)); i++)
 			{
 				fill_buf[i] = fill_val;
 			}
@@ -3023,39 +3092,49 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 			if(total_blocks > (UINT_MAX - chunk_header->chunk_sz))
 			{
 				fastboot_fail("bogus size for chunk FILL type");
-				free(fill_buf);
-				return;
+				goto out_flush;
 			}
 
-			for (i = 0; i < chunk_blk_cnt; i++)
+			while (chunk_blk_cnt)
 			{
+				fill_blk_cnt = MIN(fill_blk_cnt, chunk_blk_cnt);
+
 				/* Make sure that the data written to partition does not exceed partition size */
-				if ((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz + sparse_header->blk_sz > size)
+				if ((uint64_t)total_blocks * (uint64_t)sparse_header->blk_sz +
+				    (uint64_t)fill_blk_cnt * sparse_header->blk_sz > size)
 				{
 					fastboot_fail("Chunk data size for fill type exceeds partition size");
-					free(fill_buf);
-					return;
+					goto out_flush;
 				}
 
-				if(mmc_write(ptn + ((uint64_t)total_blocks*sparse_header->blk_sz),
-							sparse_header->blk_sz,
+				if(sparse_write(&write_queue,
+							ptn + ((uint64_t)total_blocks*sparse_header->blk_sz),
+							fill_blk_cnt * sparse_header->blk_sz,
 							fill_buf))
 				{
 					fastboot_fail("flash write failure");
-					free(fill_buf);
-					return;
+					goto out_flush;
 				}
 
-				total_blocks++;
+				total_blocks += fill_blk_cnt;
+				chunk_blk_cnt -= fill_blk_cnt;
+			}
+
+			/* The queue may still point to the fill buffer */
+			if (sparse_write_flush(&write_queue))
+			{
+				fastboot_fail("flash write failure");
+				goto out_flush;
 			}
 
 			free(fill_buf);
+			fill_buf = NULL;
 			break;
 
 			case CHUNK_TYPE_DONT_CARE:
 			if(total_blocks > (UINT_MAX - chunk_header->chunk_sz)) {
 				fastboot_fail("bogus size for chunk DONT CARE type");
-				return;
+				goto out_flush;
 			}
 			total_blocks += chunk_header->chunk_sz;
 			break;
@@ -3064,31 +3143,37 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 			if(chunk_header->total_sz != sparse_header->chunk_hdr_sz)
 			{
 				fastboot_fail("Bogus chunk size for chunk type Dont Care");
-				return;
+				goto out_flush;
 			}
 			if(total_blocks > (UINT_MAX - chunk_header->chunk_sz)) {
 				fastboot_fail("bogus size for chunk CRC type");
-				return;
+				goto out_flush;
 			}
 			total_blocks += chunk_header->chunk_sz;
 			if ((uint32_t)data > UINT_MAX - chunk_data_sz) {
 				fastboot_fail("integer overflow occured");
-				return;
+				goto out_flush;
 			}
 			data += chunk_data_sz;
 			if (data_end < (uint32_t)data) {
 				fastboot_fail("buffer overreads occured due to invalid sparse header");
-				return;
+				goto out_flush;
 			}
 			break;
 
 			default:
 			dprintf(CRITICAL, "Unkown chunk type: %x\n",chunk_header->chunk_type);
 			fastboot_fail("Unknown chunk type");
-			return;
+			goto out_flush;
 		}
 	}
 
+	if (sparse_write_flush(&write_queue))
+	{
+		fastboot_fail("flash write failure");
+		return;
+	}
+
 	dprintf(INFO, "Wrote %d blocks, expected to write %d blocks\n",
 					total_blocks, sparse_header->total_blks);
 
@@ -3099,6 +3184,11 @@ void cmd_flash_mmc_sparse_img(const char *arg, void *data, unsigned sz)
 
 	fastboot_okay("");
 	return;
+
+out_flush:
+	/* Still write what was queued before the error, as without the queue */
+	sparse_write_flush(&write_queue);
+	free(fill_buf);
 }
 
 void cmd_flash_mmc(const char *arg, void *data, unsigned sz)
@@ -3320,6 +3410,9 @@ static inline uint64_t validate_partition_size(struct ptentry *ptn)
 
 void cmd_flash(const char *arg, void *data, unsigned sz)
 {
+	/* The contents change, probe all partitions again for fs-boot */
+	fsboot_probe_reset();
+
 #if CHECK_BAT_VOLTAGE
 	if (!target_battery_soc_ok()) {
 		fastboot_fail("Warning: battery's capacity is very low\n");
@@ -3931,11 +4024,72 @@ __WEAK void target_fastboot_register_commands(void)
 {
 }
 
+#if MMC_SDHCI_SUPPORT
+#define BOOT_PREFETCH_MAX_RANGES	16
+
+static void boot_prefetch_add(struct mmc_prefetch_range *ranges, int *count,
+			      const char *name, uint32_t size, bool last)
+{
+	unsigned long long offset, ptn_size;
+	int index;
+
+	if (*count >= BOOT_PREFETCH_MAX_RANGES)
+		return;
+
+	index = partition_get_index(name);
+	if (index == INVALID_PTN)
+		return;
+
+	offset = partition_get_offset(index);
+	ptn_size = partition_get_size(index);
+	if (!offset || ptn_size < size)
+		return;
+
+	if (last)
+		offset += ptn_size - size;
+
+	ranges[*count].blk_addr = offset / mmc_blocksize;
+	ranges[*count].num_blocks = ROUNDUP(size, mmc_blocksize) / mmc_blocksize;
+	(*count)++;
+}
+
+/*
+ * Read the small metadata blocks needed to decide how to boot (boot image
+ * header, bootselect, fs-boot superblocks) in one sorted pass over the eMMC
+ * instead of issuing them one by one from the places that need them.
+ */
+static void boot_metadata_prefetch(void)
+{
+	struct mmc_prefetch_range ranges[BOOT_PREFETCH_MAX_RANGES];
+	int count = 0;
+
+	if (!target_is_emmc_boot() || !mmc_blocksize)
+		return;
+
+	boot_prefetch_add(ranges, &count, "bootselect", page_size, false);
+	boot_prefetch_add(ranges, &count, "boot", page_size, false);
+#if !DISABLE_LOCK
+	boot_prefetch_add(ranges, &count, frp_ptns[0], mmc_blocksize, true);
+	boot_prefetch_add(ranges, &count, frp_ptns[1], mmc_blocksize, true);
+#endif
+
+	count += fsboot_prefetch_ranges(&ranges[count],
+					BOOT_PREFETCH_MAX_RANGES - count);
+
+	if (mmc_prefetch(ranges, count))
+		dprintf(INFO, "Boot metadata prefetch failed\n");
+}
+#endif
+
 void aboot_init(const struct app_descriptor *app)
 {
 	unsigned reboot_mode = 0;
 	bool boot_into_fastboot = false;
 
+#if LK2ND_PROFILE_BOOT
+	lk2nd_profile_start(LK2ND_PROFILE_BOOT);
+#endif
+
 	/* Setup page size information for nv storage */
 	if (target_is_emmc_boot())
 	{
@@ -3974,6 +4128,10 @@ void aboot_init(const struct app_descriptor *app)
 	lk2nd_init();
 #endif
 
+#if MMC_SDHCI_SUPPORT
+	boot_metadata_prefetch();
+#endif
+
 	/* Check if we should do something other than booting up */
 	if (keys_get_state(KEY_VOLUMEUP) && keys_get_state(KEY_VOLUMEDOWN))
 	{
@@ -4095,6 +4253,17 @@ normal_boot:
 
 	/* We are here means regular boot did not happen. Start fastboot. */
 
+#if MMC_SDHCI_SUPPORT
+	/* Boot metadata is no longer needed, fastboot may rewrite it */
+	if (target_is_emmc_boot())
+		mmc_prefetch_drop();
+#endif
+
+#if LK2ND_BOOT_CACHE
+	/* Must be reserved before max-download-size is published */
+	lk2nd_boot_cache_init();
+#endif
+
 	/* register aboot specific fastboot commands */
 	aboot_fastboot_register_commands();
 	fastboot_extra_register_commands();
@@ -4111,6 +4280,9 @@ normal_boot:
 
 	/* initialize and start fastboot */
 	fastboot_init(target_get_scratch_address(), target_get_max_flash_size());
+#if LK2ND_SCRUB
+	lk2nd_scrub_start();
+#endif
 #if FBCON_DISPLAY_MSG
 	display_fastboot_menu();
 #endif
@@ -116,6 +116,12 @@ static void cmd_oem_lk_log(const char *arg, void *data, unsigned sz)
 {
 	fastboot_stage(lk_log_getbuf(), lk_log_getsize());
 }
+
+/* Messages with time stamps and levels */
+static void cmd_oem_log(const char *arg, void *data, unsigned sz)
+{
+	fastboot_stage(data, lk_log_read(data, target_get_max_flash_size()));
+}
 #endif
 
 static void cmd_oem_screenshot(const char *arg, void *data, unsigned sz)
@@ -441,6 +447,7 @@ void fastboot_extra_register_commands(void) {
 
 #if WITH_DEBUG_LOG_BUF
 	fastboot_register("oem lk_log", cmd_oem_lk_log);
+	fastboot_register("oem log", cmd_oem_log);
 #endif
 #if DISPLAY_SPLASH_SCREEN
 	fastboot_register("oem screenshot", cmd_oem_screenshot);
@@ -1,6 +1,14 @@
+#include <ctype.h>
+#include <debug.h>
+#include <dma.h>
 #include <libfdt.h>
+#include <limits.h>
 #include <lk2nd.h>
+#include <partition_parser.h>
+#include <stdlib.h>
 #include <string.h>
+#include <target.h>
+#include "bootimg.h"
 #include "fastboot.h"
 
 static void cmd_oem_dtb(const char *arg, void *data, unsigned sz)
@@ -13,13 +21,370 @@ static void cmd_oem_cmdline(const char *arg, void *data, unsigned sz)
 	fastboot_stage(lk2nd_dev.cmdline, strlen(lk2nd_dev.cmdline));
 }
 
+/*
+ * Flash plan: flash several partitions from one download, without a round
+ * trip for each partition. The download starts with a text manifest:
+ *
+ *   lk2nd-flash-plan
+ *   <partition> <offset> <size>
+ *   ...
+ *   <empty line>
+ *
+ * followed by the images at the given offsets (relative to the start of the
+ * download, aligned to FLASH_PLAN_ALIGN). The progress is published in the
+ * "flash-plan" variable.
+ */
+#define FLASH_PLAN_MAGIC	"lk2nd-flash-plan\n"
+#define FLASH_PLAN_MAX_ENTRIES	32
+#define FLASH_PLAN_MAX_LINE	128
+#define FLASH_PLAN_ALIGN	4096
+
+struct flash_plan_entry {
+	char name[MAX_GPT_NAME_SIZE];
+	unsigned offset;
+	unsigned size;
+};
+
+extern void cmd_flash(const char *arg, void *data, unsigned sz);
+
+static struct flash_plan_entry flash_plan[FLASH_PLAN_MAX_ENTRIES];
+static char flash_plan_status[MAX_RSP_SIZE] = "idle";
+
+/* Like atoul(), but rejects empty numbers, trailing garbage and overflows */
+static bool flash_plan_parse_num(const char *num, unsigned *out)
+{
+	unsigned long long value = 0;
+	unsigned base = 10, digit;
+
+	if (num[0] == '0' && num[1] == 'x') {
+		base = 16;
+		num += 2;
+	}
+	if (!*num)
+		return false;
+
+	for (; *num; num++) {
+		if (isdigit(*num))
+			digit = *num - '0';
+		else if (base == 16 && isxdigit(*num))
+			digit = tolower(*num) - 'a' + 10;
+		else
+			return false;
+
+		value = value * base + digit;
+		if (value > UINT_MAX)
+			return false;
+	}
+
+	*out = value;
+	return true;
+}
+
+static bool flash_plan_parse_entry(char *line, struct flash_plan_entry *e,
+				   unsigned sz)
+{
+	char *saveptr;
+	char *name = strtok_r(line, " ", &saveptr);
+	char *offset = strtok_r(NULL, " ", &saveptr);
+	char *size = strtok_r(NULL, " ", &saveptr);
+
+	if (!name || !offset || !size || strtok_r(NULL, " ", &saveptr))
+		return false;
+	if (strlcpy(e->name, name, sizeof(e->name)) >= sizeof(e->name))
+		return false;
+
+	if (!flash_plan_parse_num(offset, &e->offset) ||
+	    !flash_plan_parse_num(size, &e->size))
+		return false;
+
+	return e->size && e->offset % FLASH_PLAN_ALIGN == 0 &&
+	       e->offset < sz && e->size <= sz - e->offset;
+}
+
+/* The images must not overwrite the manifest itself */
+static int flash_plan_check(int count, unsigned manifest_size)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (flash_plan[i].offset < manifest_size) {
+			dprintf(CRITICAL, "flash-plan: %s overlaps the manifest\n",
+				flash_plan[i].name);
+			return -1;
+		}
+	}
+
+	return count;
+}
+
+/* Returns the number of entries, or -1 if the manifest is invalid */
+static int flash_plan_parse(const char *data, unsigned sz)
+{
+	const char *p = data + strlen(FLASH_PLAN_MAGIC), *end = data + sz, *nl;
+	char line[FLASH_PLAN_MAX_LINE];
+	int count = 0;
+
+	if (sz < strlen(FLASH_PLAN_MAGIC) ||
+	    memcmp(data, FLASH_PLAN_MAGIC, strlen(FLASH_PLAN_MAGIC)))
+		return -1;
+
+	while (p < end) {
+		nl = memchr(p, '\n', end - p);
+		if (!nl || nl - p >= FLASH_PLAN_MAX_LINE)
+			return -1;
+		if (nl == p)
+			return flash_plan_check(count, nl + 1 - data);
+		if (count == FLASH_PLAN_MAX_ENTRIES)
+			return -1;
+
+		memcpy(line, p, nl - p);
+		line[nl - p] = '\0';
+		if (!flash_plan_parse_entry(line, &flash_plan[count], sz)) {
+			dprintf(CRITICAL, "flash-plan: Invalid entry: %s\n", line);
+			return -1;
+		}
+
+		count++;
+		p = nl + 1;
+	}
+
+	return -1;
+}
+
+static void cmd_oem_flash_plan(const char *arg, void *data, unsigned sz)
+{
+	char response[MAX_RSP_SIZE];
+	int count, i;
+
+	count = flash_plan_parse(data, sz);
+	if (count <= 0) {
+		strlcpy(flash_plan_status, "failed: invalid manifest",
+			sizeof(flash_plan_status));
+		fastboot_fail("Invalid flash plan manifest");
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct flash_plan_entry *e = &flash_plan[i];
+
+		snprintf(flash_plan_status, sizeof(flash_plan_status),
+			 "%d/%d %s", i + 1, count, e->name);
+		snprintf(response, sizeof(response), "Flashing %s", flash_plan_status);
+		fastboot_info(response);
+
+		if (!fastboot_run_nested(cmd_flash, e->name, (char *)data + e->offset,
+					 e->size, response)) {
+			snprintf(flash_plan_status, sizeof(flash_plan_status),
+				 "failed %d/%d %s", i + 1, count, e->name);
+			/* Pass on the failure reason, without "FAIL" */
+			fastboot_fail(response + 4);
+			return;
+		}
+	}
+
+	snprintf(flash_plan_status, sizeof(flash_plan_status),
+		 "done %d/%d", count, count);
+	fastboot_okay("");
+}
+
+#if LK2ND_BOOT_HISTORY
+/* Use "fastboot get_staged" to receive the history */
+static void cmd_oem_boot_history(const char *arg, void *data, unsigned sz)
+{
+	size_t len = lk2nd_boot_history_dump(data, target_get_max_flash_size());
+
+	if (!len) {
+		fastboot_fail("No boot history");
+		return;
+	}
+
+	fastboot_stage(data, len);
+}
+#endif
+
+#if LK2ND_PROFILE
+static void cmd_oem_profile_start(const char *arg, void *data, unsigned sz)
+{
+	while (*arg == ' ')
+		arg++;
+
+	lk2nd_profile_start(*arg ? atoi(arg) : 1000);
+	fastboot_okay("");
+}
+
+static void cmd_oem_profile_stop(const char *arg, void *data, unsigned sz)
+{
+	lk2nd_profile_stop();
+	fastboot_okay("");
+}
+
+/* Use "fastboot get_staged" to receive the samples */
+static void cmd_oem_profile_dump(const char *arg, void *data, unsigned sz)
+{
+	size_t len = lk2nd_profile_dump(data, target_get_max_flash_size());
+
+	if (!len) {
+		fastboot_fail("Profile does not fit into the download buffer");
+		return;
+	}
+
+	fastboot_stage(data, len);
+}
+#endif
+
+#if LK2ND_SCRUB
+/* Use "fastboot get_staged" to receive the slow regions */
+static void cmd_oem_scrub(const char *arg, void *data, unsigned sz)
+{
+	fastboot_stage(data, lk2nd_scrub_report(data, target_get_max_flash_size()));
+}
+
+static void cmd_oem_scrub_start(const char *arg, void *data, unsigned sz)
+{
+	lk2nd_scrub_start();
+	fastboot_okay("");
+}
+#endif
+
+#if LK2ND_BOOT_CACHE
+/*
+ * Boot image cache: boot a boot image from sections that are already in
+ * the cache, so repeated "fastboot boot" only needs to send what changed.
+ *
+ *   fastboot stage <manifest> && fastboot oem cache-boot
+ *
+ * The manifest is the boot image header (one page) followed by the SHA-256
+ * digests of the kernel, ramdisk, second and dt sections (in this order,
+ * digests of empty sections are ignored). If some sections are missing,
+ * the command fails with their names, the host then sends each of them with
+ *
+ *   fastboot stage <section> && fastboot oem cache-put
+ *
+ * and retries.
+ */
+enum {
+	BOOT_CACHE_KERNEL,
+	BOOT_CACHE_RAMDISK,
+	BOOT_CACHE_SECOND,
+	BOOT_CACHE_DT,
+	BOOT_CACHE_SECTIONS,
+};
+
+static const char * const boot_cache_names[BOOT_CACHE_SECTIONS] = {
+	"kernel", "ramdisk", "second", "dt",
+};
+
+extern void cmd_boot(const char *arg, void *data, unsigned sz);
+
+static void cmd_oem_cache_put(const char *arg, void *data, unsigned sz)
+{
+	uint8_t digest[LK2ND_BOOT_CACHE_DIGEST_SIZE];
+
+	if (!sz) {
+		fastboot_fail("No data staged");
+		return;
+	}
+
+	if (lk2nd_boot_cache_put(data, sz, digest)) {
+		fastboot_fail("Does not fit into the cache");
+		return;
+	}
+
+	fastboot_okay("");
+}
+
+static void cmd_oem_cache_clear(const char *arg, void *data, unsigned sz)
+{
+	lk2nd_boot_cache_clear();
+	fastboot_okay("");
+}
+
+static void cmd_oem_cache_boot(const char *arg, void *data, unsigned sz)
+{
+	uint8_t digests[BOOT_CACHE_SECTIONS][LK2ND_BOOT_CACHE_DIGEST_SIZE];
+	const void *sections[BOOT_CACHE_SECTIONS];
+	unsigned sizes[BOOT_CACHE_SECTIONS];
+	char missing[MAX_RSP_SIZE] = "missing";
+	unsigned max = target_get_max_flash_size();
+	unsigned page, offset;
+	struct boot_img_hdr *hdr = data;
+	int i;
+
+	if (sz < sizeof(*hdr) ||
+	    memcmp(hdr->magic, BOOT_MAGIC, BOOT_MAGIC_SIZE) ||
+	    !hdr->page_size || (hdr->page_size & (hdr->page_size - 1)) ||
+	    hdr->page_size > max / 2 ||
+	    sz < hdr->page_size + sizeof(digests)) {
+		fastboot_fail("invalid manifest");
+		return;
+	}
+
+	page = hdr->page_size;
+	memcpy(digests, (uint8_t *)data + page, sizeof(digests));
+
+	sizes[BOOT_CACHE_KERNEL] = hdr->kernel_size;
+	sizes[BOOT_CACHE_RAMDISK] = hdr->ramdisk_size;
+	sizes[BOOT_CACHE_SECOND] = hdr->second_size;
+#ifndef OSVERSION_IN_BOOTIMAGE
+	sizes[BOOT_CACHE_DT] = hdr->dt_size;
+#else
+	sizes[BOOT_CACHE_DT] = 0;
+#endif
+
+	/* Look up everything first, so the host learns all missing sections */
+	offset = page;
+	for (i = 0; i < BOOT_CACHE_SECTIONS; i++) {
+		sections[i] = NULL;
+		if (!sizes[i])
+			continue;
+
+		sections[i] = lk2nd_boot_cache_get(digests[i], sizes[i]);
+		if (!sections[i]) {
+			strlcat(missing, " ", sizeof(missing));
+			strlcat(missing, boot_cache_names[i], sizeof(missing));
+		}
+
+		/* Sections are page aligned, account for the padding as well */
+		if (sizes[i] > max - offset ||
+		    ROUNDUP(sizes[i], page) > max - offset) {
+			fastboot_fail("boot image is too large");
+			return;
+		}
+		offset += ROUNDUP(sizes[i], page);
+	}
+
+	if (strcmp(missing, "missing")) {
+		fastboot_fail(missing);
+		return;
+	}
+
+	/* Assemble the image behind the header, as "fastboot boot" expects it */
+	offset = page;
+	for (i = 0; i < BOOT_CACHE_SECTIONS; i++) {
+		if (!sizes[i])
+			continue;
+
+		memcpy((uint8_t *)data + offset, sections[i], sizes[i]);
+		offset += ROUNDUP(sizes[i], page);
+	}
+	dma_forget(data, offset);
+
+	lk2nd_boot_cache_keep();
+	cmd_boot("", data, offset);
+}
+#endif
+
 #if TARGET_MSM8916
 extern status_t smb1360_reload(const struct smb1360 *smb);
+extern void smb1360_wait(void);
 
 static void cmd_oem_smb1360_reload(const char *arg, void *data, unsigned sz)
 {
 	status_t ret;
 
+	/* Don't interfere with the battery detection */
+	smb1360_wait();
+
 	fastboot_info("Reloading smb1360 charger registers from OTP...");
 	if (smb1360_reload(lk2nd_dev.smb1360))
 		fastboot_fail("");
@@ -29,12 +394,36 @@ static void cmd_oem_smb1360_reload(const char *arg, void *data, unsigned sz)
 #endif
 
 void fastboot_lk2nd_register_commands(void) {
+	fastboot_register("oem flash-plan", cmd_oem_flash_plan);
+	fastboot_publish("flash-plan", flash_plan_status);
+
 	if (lk2nd_dev.fdt)
 		fastboot_register("oem dtb", cmd_oem_dtb);
 
 	if (lk2nd_dev.cmdline)
 		fastboot_register("oem cmdline", cmd_oem_cmdline);
 
+#if LK2ND_BOOT_HISTORY
+	fastboot_register("oem boot-history", cmd_oem_boot_history);
+#endif
+
+#if LK2ND_BOOT_CACHE
+	fastboot_register("oem cache-put", cmd_oem_cache_put);
+	fastboot_register("oem cache-boot", cmd_oem_cache_boot);
+	fastboot_register("oem cache-clear", cmd_oem_cache_clear);
+#endif
+
+#if LK2ND_SCRUB
+	fastboot_register("oem scrub", cmd_oem_scrub);
+	fastboot_register("oem scrub-start", cmd_oem_scrub_start);
+#endif
+
+#if LK2ND_PROFILE
+	fastboot_register("oem profile-start", cmd_oem_profile_start);
+	fastboot_register("oem profile-stop", cmd_oem_profile_stop);
+	fastboot_register("oem profile-dump", cmd_oem_profile_dump);
+#endif
+
 #if TARGET_MSM8916
 	if (lk2nd_dev.smb1360)
 		fastboot_register("oem smb1360-reload", cmd_oem_smb1360_reload);
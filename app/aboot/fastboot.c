@@ -35,9 +35,16 @@
 #include <target.h>
 #include <kernel/thread.h>
 #include <kernel/event.h>
+#include <kernel/mutex.h>
 #include <dev/udc.h>
+#include <crc32.h>
+#include <dma.h>
 #include "fastboot.h"
 
+#if LK2ND_SCRUB
+#include <lk2nd.h>
+#endif
+
 #ifdef USB30_SUPPORT
 #include <usb30_udc.h>
 #endif
@@ -158,6 +165,8 @@ void fastboot_publish(const char *name, const char *value)
 
 static event_t usb_online;
 static event_t txn_done;
+/* Held while a command runs, see fastboot_lock() */
+static mutex_t cmd_lock;
 static struct udc_endpoint *in, *out;
 static struct udc_request *req;
 int txn_status;
@@ -167,6 +176,16 @@ static void *download_base;
 static unsigned download_max;
 static unsigned download_size;
 
+/*
+ * CRC-32 (as used by zlib/gzip) of the last download, calculated while the
+ * data is received and published as "download-crc32".
+ */
+static uint32_t *usb_read_crc;
+static char download_crc_str[11];
+
+/* Set while running a nested command, see fastboot_run_nested() */
+static char *nested_response;
+
 #define STATE_OFFLINE	0
 #define STATE_COMMAND	1
 #define STATE_COMPLETE	2
@@ -221,7 +240,11 @@ static int usb30_usb_read(void *buf, unsigned len)
 	dprintf(SPEW, "usb_read(): DONE. req.length = %d\n", req.length);
 
 	/* invalidate any cached buf data (controller updates main memory) */
-	arch_invalidate_cache_range((addr_t) buf, len);
+	dma_unmap(buf, len, DMA_FROM_DEVICE);
+
+	/* The whole buffer is transferred at once, nothing to overlap with */
+	if (usb_read_crc)
+		*usb_read_crc = crc32(*usb_read_crc, buf, req.length);
 
 	return req.length;
 
@@ -245,7 +268,7 @@ static int usb30_usb_write(void *buf, unsigned len)
 	dprintf(SPEW, "usb_write(): len = %d str = %s\n", len, (char *) buf);
 
 	/* flush buffer to main memory before giving to udc */
-	arch_clean_invalidate_cache_range((addr_t) buf, len);
+	dma_map(buf, len, DMA_TO_DEVICE);
 
 	req.buf      = (void*) PA((addr_t)buf);
 	req.length   = len;
@@ -281,6 +304,8 @@ static int hsusb_usb_read(void *_buf, unsigned len)
 	int r;
 	unsigned xfer;
 	unsigned char *buf = _buf;
+	unsigned char *prev = NULL;
+	unsigned prev_len = 0;
 	int count = 0;
 
 	if (fastboot_state == STATE_ERROR)
@@ -296,6 +321,14 @@ static int hsusb_usb_read(void *_buf, unsigned len)
 			dprintf(INFO, "usb_read() queue failed\n");
 			goto oops;
 		}
+
+		/* Finish (and checksum) the previous chunk while this one is transferred */
+		if (prev_len) {
+			dma_unmap(prev, prev_len, DMA_FROM_DEVICE);
+			if (usb_read_crc)
+				*usb_read_crc = crc32(*usb_read_crc, prev, prev_len);
+		}
+
 		event_wait(&txn_done);
 
 		if (txn_status < 0) {
@@ -303,6 +336,9 @@ static int hsusb_usb_read(void *_buf, unsigned len)
 			goto oops;
 		}
 
+		prev = buf;
+		prev_len = req->length;
+
 		count += req->length;
 		buf += req->length;
 		len -= req->length;
@@ -311,10 +347,15 @@ static int hsusb_usb_read(void *_buf, unsigned len)
 		if (req->length != xfer) break;
 	}
 	/*
-	 * Force reload of buffer from memory
+	 * Force reload of the last chunk from memory
 	 * since transaction is complete now.
 	 */
-	arch_invalidate_cache_range(_buf, count);
+	if (prev_len) {
+		dma_unmap(prev, prev_len, DMA_FROM_DEVICE);
+		if (usb_read_crc)
+			*usb_read_crc = crc32(*usb_read_crc, prev, prev_len);
+	}
+
 	return count;
 
 oops:
@@ -376,10 +417,38 @@ void fastboot_ack(const char *code, const char *reason)
 	snprintf(response, MAX_RSP_SIZE, "%s%s", code, reason);
 	fastboot_state = STATE_COMPLETE;
 
+	if (nested_response) {
+		strlcpy(nested_response, response, MAX_RSP_SIZE);
+		return;
+	}
+
 	usb_if.usb_write(response, strlen(response));
 
 }
 
+/*
+ * Run another command handler as part of the current command. Its final
+ * OKAY/FAIL is stored in response (MAX_RSP_SIZE) instead of being sent
+ * to the host, so the current command can continue afterwards.
+ */
+bool fastboot_run_nested(void (*handle)(const char *arg, void *data, unsigned sz),
+			 const char *arg, void *data, unsigned sz, char *response)
+{
+	if (fastboot_state != STATE_COMMAND || nested_response)
+		return false;
+
+	strlcpy(response, "FAILunknown reason", MAX_RSP_SIZE);
+	nested_response = response;
+	handle(arg, data, sz);
+	nested_response = NULL;
+
+	if (fastboot_state == STATE_ERROR)
+		return false;
+
+	fastboot_state = STATE_COMMAND;
+	return !strncmp(response, "OKAY", 4);
+}
+
 void fastboot_info(const char *reason)
 {
 	STACKBUF_DMA_ALIGN(response, MAX_RSP_SIZE);
@@ -415,11 +484,13 @@ void fastboot_okay(const char *info)
 void fastboot_stage(const void *data, unsigned sz)
 {
 	download_size = 0;
+	download_crc_str[0] = '\0';
 	if (sz > download_max) {
 		fastboot_fail("data too large");
 		return;
 	}
 
+	dma_forget(download_base, sz);
 	if (data != download_base)
 		memcpy(download_base, data, sz);
 	download_size = sz;
@@ -466,9 +537,11 @@ static void cmd_download(const char *arg, void *data, unsigned sz)
 {
 	STACKBUF_DMA_ALIGN(response, MAX_RSP_SIZE);
 	unsigned len = hex2unsigned(arg);
+	uint32_t crc = ~0U;
 	int r;
 
 	download_size = 0;
+	download_crc_str[0] = '\0';
 	if (len > download_max) {
 		fastboot_fail("data too large");
 		return;
@@ -478,16 +551,23 @@ static void cmd_download(const char *arg, void *data, unsigned sz)
 	if (usb_if.usb_write(response, strlen(response)) < 0)
 		return;
 	/*
-	 * Discard the cache contents before starting the download
+	 * Discard the cache contents before starting the download. The CPU
+	 * only reads the downloaded data, so it stays clean until the next
+	 * command completes (see fastboot_command_loop()) and can be flashed
+	 * without another pass over the cache.
 	 */
-	arch_invalidate_cache_range((addr_t) download_base, sz);
+	dma_map(download_base, len, DMA_FROM_DEVICE);
+	dma_mark_clean(download_base, len);
 
+	usb_read_crc = &crc;
 	r = usb_if.usb_read(download_base, len);
+	usb_read_crc = NULL;
 	if ((r < 0) || ((unsigned) r != len)) {
 		fastboot_state = STATE_ERROR;
 		return;
 	}
 	download_size = len;
+	snprintf(download_crc_str, sizeof(download_crc_str), "0x%08x", ~crc);
 	fastboot_okay("");
 }
 
@@ -555,8 +635,19 @@ again:
 			if(arg[0]==' ')
 				arg++;
 
+			mutex_acquire(&cmd_lock);
+#if LK2ND_SCRUB
+			/* Keep the storage to the command while it runs */
+			lk2nd_scrub_pause();
+#endif
 			cmd->handle(arg,
 				    (void*) download_base, download_size);
+#if LK2ND_SCRUB
+			lk2nd_scrub_resume();
+#endif
+			mutex_release(&cmd_lock);
+			if (cmd->handle != cmd_download)
+				dma_forget(download_base, download_max);
 			if (fastboot_state == STATE_COMMAND)
 				fastboot_fail("unknown reason");
 			goto again;
@@ -648,6 +739,7 @@ int fastboot_init(void *base, unsigned size)
 
 	event_init(&usb_online, 0, EVENT_FLAG_AUTOUNSIGNAL);
 	event_init(&txn_done, 0, EVENT_FLAG_AUTOUNSIGNAL);
+	mutex_init(&cmd_lock);
 
 	in = usb_if.udc_endpoint_alloc(UDC_TYPE_BULK_IN, 512);
 	if (!in)
@@ -672,6 +764,7 @@ int fastboot_init(void *base, unsigned size)
 	fastboot_register("download:", cmd_download);
 	fastboot_register("upload", cmd_upload);
 	fastboot_publish("version", "0.5");
+	fastboot_publish("download-crc32", download_crc_str);
 
 	thr = thread_create("fastboot", fastboot_handler, 0, DEFAULT_PRIORITY, 4096);
 	if (!thr)
@@ -695,6 +788,20 @@ fail_alloc_in:
 	return -1;
 }
 
+/*
+ * Wait until no command is running and keep new ones from starting,
+ * for other threads (e.g. the menu) that access the storage.
+ */
+void fastboot_lock(void)
+{
+	mutex_acquire(&cmd_lock);
+}
+
+void fastboot_unlock(void)
+{
+	mutex_release(&cmd_lock);
+}
+
 void fastboot_stop(void)
 {
 	if (!udc_started)
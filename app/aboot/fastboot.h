@@ -39,6 +39,8 @@ void fastboot_lk2nd_register_commands(void);
 
 int fastboot_init(void *xfer_buffer, unsigned max);
 void fastboot_stop(void);
+void fastboot_lock(void);
+void fastboot_unlock(void);
 
 /* register a command handler
  * - command handlers will be called if their prefix matches
@@ -56,6 +58,8 @@ void fastboot_okay(const char *result);
 void fastboot_fail(const char *reason);
 void fastboot_info(const char *reason);
 void fastboot_stage(const void *data, unsigned sz);
+bool fastboot_run_nested(void (*handle)(const char *arg, void *data, unsigned sz),
+			 const char *arg, void *data, unsigned sz, char *response);
 
 
 #endif
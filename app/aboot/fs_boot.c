@@ -1,12 +1,18 @@
 // SPDX-License-Identifier: GPL-2.0-only
 
 #include <debug.h>
+#include <lk2nd.h>
 #include <target.h>
+#include <stdlib.h>
 #include <string.h>
+#include <mmc.h>
+#include <partition_parser.h>
+#include <crc32.h>
 
 #include <lib/bio.h>
 #include <lib/fs.h>
 
+#include "fastboot.h"
 #include "fs_boot.h"
 
 struct fs_boot_data fs_boot_data;
@@ -30,6 +36,202 @@ static bool fsboot_bootable_part(char *label)
 	return false;
 }
 
+/*
+ * Quick checks to avoid mounting partitions that cannot contain a file
+ * system to boot from: the partition type and name first, then the ext2
+ * magic from a single block. Rejected partitions are remembered until
+ * fsboot_probe_reset().
+ */
+#define FSBOOT_PROBE_CACHE_SIZE		64
+#define FSBOOT_PROBE_NAME_LEN		16
+
+#define EXT2_MAGIC_OFFSET		(1024 + 56)
+#define EXT2_MAGIC			0xef53
+
+/* GPT type GUIDs are stored mixed-endian on disk */
+#define GPT_TYPE_GUID(a, b, c, d, e) { \
+	(a) & 0xff, ((a) >> 8) & 0xff, ((a) >> 16) & 0xff, ((a) >> 24) & 0xff, \
+	(b) & 0xff, ((b) >> 8) & 0xff, (c) & 0xff, ((c) >> 8) & 0xff, \
+	((d) >> 8) & 0xff, (d) & 0xff, \
+	((e) >> 40) & 0xff, ((e) >> 32) & 0xff, ((e) >> 24) & 0xff, \
+	((e) >> 16) & 0xff, ((e) >> 8) & 0xff, (e) & 0xff }
+
+/* Partition types that never hold an ext2/3/4 file system */
+static const uint8_t fsboot_reject_guids[][16] = {
+	GPT_TYPE_GUID(0xC12A7328, 0xF81F, 0x11D2, 0xBA4B, 0x00A0C93EC93BULL), /* EFI system */
+	GPT_TYPE_GUID(0x21686148, 0x6449, 0x6E6F, 0x744E, 0x656564454649ULL), /* BIOS boot */
+	GPT_TYPE_GUID(0x0657FD6D, 0xA4AB, 0x43C4, 0x84E5, 0x0933C84B4F4FULL), /* Linux swap */
+	GPT_TYPE_GUID(0xDEA0BA2C, 0xCBDD, 0x4805, 0xB4F9, 0xF428251C3E98ULL), /* sbl1 */
+	GPT_TYPE_GUID(0x098DF793, 0xD712, 0x413D, 0x9D4E, 0x89D711772228ULL), /* rpm */
+	GPT_TYPE_GUID(0xA053AA7F, 0x40B8, 0x4B1C, 0xBA08, 0x2F68AC71A4F4ULL), /* tz */
+	GPT_TYPE_GUID(0xE1A6A689, 0x0C8D, 0x4CC6, 0xB4E8, 0x55A4320FBD8AULL), /* hyp */
+	GPT_TYPE_GUID(0x400FFDCD, 0x22E0, 0x47E7, 0x9A23, 0xF16ED9382388ULL), /* aboot */
+	GPT_TYPE_GUID(0x20117F86, 0xE985, 0x4357, 0xB9EE, 0x374BC1D8487DULL), /* boot */
+	GPT_TYPE_GUID(0x9D72D4E4, 0x9958, 0x42DA, 0xAC26, 0xBEA7A90B0434ULL), /* recovery */
+	GPT_TYPE_GUID(0xEBBEADAF, 0x22C9, 0xE33B, 0x8F5D, 0x0E81686A68CBULL), /* modemst1 */
+	GPT_TYPE_GUID(0x0A288B1F, 0x22C9, 0xE33B, 0x8F5D, 0x0E81686A68CBULL), /* modemst2 */
+	GPT_TYPE_GUID(0x638FF8E2, 0x22C9, 0xE33B, 0x8F5D, 0x0E81686A68CBULL), /* fsg */
+	GPT_TYPE_GUID(0x57B90A16, 0x22C9, 0xE33B, 0x8F5D, 0x0E81686A68CBULL), /* fsc */
+	GPT_TYPE_GUID(0x2C86E742, 0x745E, 0x4FDD, 0xBFD8, 0xB6A7AC638772ULL), /* ssd */
+	GPT_TYPE_GUID(0x82ACC91F, 0x357C, 0x4A68, 0x9C8F, 0x689E1B1A23A1ULL), /* misc */
+	GPT_TYPE_GUID(0x20A0C19C, 0x286A, 0x42FA, 0x9CE7, 0xF64C3226A794ULL), /* DDR */
+};
+
+/*
+ * Raw (firmware) partitions, matched exactly or with one of the suffixes below.
+ * "boot" and "recovery" are common labels of ext2 partitions on SD cards,
+ * so the Android ones are only rejected by their type GUID.
+ */
+static const char *fsboot_reject_names[] = {
+	"sbl1",
+	"rpm",
+	"tz",
+	"hyp",
+	"aboot",
+	"modemst1",
+	"modemst2",
+	"fsg",
+	"fsc",
+	"ssd",
+	"misc",
+	"DDR",
+	"sec",
+	"devinfo",
+	"keystore",
+	"splash",
+};
+
+static const char *fsboot_reject_suffixes[] = {
+	"",
+	"bak",
+	"_a",
+	"_b",
+};
+
+static char fsboot_probe_rejected[FSBOOT_PROBE_CACHE_SIZE][FSBOOT_PROBE_NAME_LEN];
+static int fsboot_probe_rejected_count;
+
+void fsboot_probe_reset(void)
+{
+	fsboot_probe_rejected_count = 0;
+}
+
+static bool fsboot_probe_is_rejected(const char *dev_name)
+{
+	int i;
+	for (i = 0; i < fsboot_probe_rejected_count; ++i)
+		if (strcmp(fsboot_probe_rejected[i], dev_name) == 0)
+			return true;
+
+	return false;
+}
+
+static void fsboot_probe_reject(const char *dev_name)
+{
+	if (fsboot_probe_rejected_count >= FSBOOT_PROBE_CACHE_SIZE ||
+	    strlen(dev_name) >= FSBOOT_PROBE_NAME_LEN)
+		return;
+
+	strcpy(fsboot_probe_rejected[fsboot_probe_rejected_count++], dev_name);
+}
+
+static bool fsboot_reject_label(const char *label)
+{
+	size_t len;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(fsboot_reject_names); ++i) {
+		len = strlen(fsboot_reject_names[i]);
+		if (strncmp(label, fsboot_reject_names[i], len) != 0)
+			continue;
+
+		for (j = 0; j < ARRAY_SIZE(fsboot_reject_suffixes); ++j)
+			if (strcmp(label + len, fsboot_reject_suffixes[j]) == 0)
+				return true;
+	}
+
+	return false;
+}
+
+static bool fsboot_reject_type(const uint8_t *type_guid, unsigned mbr_type)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fsboot_reject_guids); ++i)
+		if (memcmp(type_guid, fsboot_reject_guids[i], 16) == 0)
+			return true;
+
+	switch (mbr_type) {
+	case 0x01: case 0x04: case 0x06: case 0x0b: case 0x0c: case 0x0e: /* FAT */
+	case 0x05: case 0x0f: case 0x85: /* Extended */
+	case 0x07: /* NTFS/exFAT */
+	case 0x82: /* Linux swap */
+		return true;
+	}
+
+	return false;
+}
+
+static bool fsboot_probe_type(bdev_t *dev)
+{
+	if (fsboot_reject_type(dev->part_type_guid, dev->part_mbr_type))
+		return false;
+
+	if (dev->label && fsboot_reject_label(dev->label))
+		return false;
+
+	return true;
+}
+
+/* Check the ext2 superblock magic by reading the one block that contains it */
+static bool fsboot_probe_magic(bdev_t *dev)
+{
+	off_t offset = ROUNDDOWN(EXT2_MAGIC_OFFSET, dev->block_size);
+	STACKBUF_DMA_ALIGN(buf, dev->block_size);
+	uint8_t *magic = buf + (EXT2_MAGIC_OFFSET - offset);
+
+	if (dev->size < EXT2_MAGIC_OFFSET + 2)
+		return false;
+
+	if (bio_read(dev, buf, offset, dev->block_size) < (ssize_t)dev->block_size)
+		return false;
+
+	return (magic[0] | magic[1] << 8) == EXT2_MAGIC;
+}
+
+static bool fsboot_probe(const char *dev_name)
+{
+	bdev_t *dev;
+	bool ok;
+
+	if (fsboot_probe_is_rejected(dev_name))
+		return false;
+
+	dev = bio_open(dev_name);
+	if (!dev)
+		return false;
+
+	ok = fsboot_probe_type(dev) && fsboot_probe_magic(dev);
+	bio_close(dev);
+
+	if (!ok)
+		fsboot_probe_reject(dev_name);
+	return ok;
+}
+
+static enum rproc_mode fsboot_parse_rproc_mode(const char *mode)
+{
+	if (strcmp(mode, "all") == 0)
+		return RPROC_MODE_ALL;
+	if (strcmp(mode, "no-modem") == 0)
+		return RPROC_MODE_NO_MODEM;
+	if (strcmp(mode, "none") == 0)
+		return RPROC_MODE_NONE;
+
+	dprintf(CRITICAL, "Unknown rproc mode: %s\n", mode);
+	return RPROC_MODE_UNKNOWN;
+}
+
 static enum rproc_mode fsboot_load_rproc_mode(const char *path)
 {
 	char mode[9] = {0};
@@ -47,15 +249,392 @@ static enum rproc_mode fsboot_load_rproc_mode(const char *path)
 	if (lf)
 		*lf = 0;
 
-	if (strcmp(mode, "all") == 0)
-		return RPROC_MODE_ALL;
-	if (strcmp(mode, "no-modem") == 0)
-		return RPROC_MODE_NO_MODEM;
-	if (strcmp(mode, "none") == 0)
-		return RPROC_MODE_NONE;
+	return fsboot_parse_rproc_mode(mode);
+}
 
-	dprintf(CRITICAL, "Unknown rproc mode: %s\n", mode);
-	return RPROC_MODE_UNKNOWN;
+/*
+ * Boot config: instead of a single boot.img, a partition can have a small
+ * config file (at most FSBOOT_CONFIG_SIZE) with several images:
+ *
+ *   entry <name> <path> [all|no-modem|none]
+ *   default <name>
+ *   fallback <name>
+ *   tries <n>
+ *
+ * The default entry (or the first one) is booted, without looking at the
+ * directory or the marker files. With LK2ND_FSBOOT_STATE, an entry can be
+ * picked for the next boot from the fastboot menu, and after <n> boots of
+ * the default entry that were not confirmed, the fallback entry is booted
+ * instead. The OS confirms a successful boot by zeroing the state block.
+ * If an image fails to load, the fallback and then the default entry are
+ * tried. Only the boot of a loaded image updates the state.
+ *
+ * The config found by the scan when entering fastboot is kept for the menu,
+ * which therefore does not need to mount anything.
+ */
+#define FSBOOT_CONFIG_PATH	"/mnt/lk2nd_boot.conf"
+#define FSBOOT_CONFIG_SIZE	1024
+#define FSBOOT_MAX_ENTRIES	8
+#define FSBOOT_NAME_LEN		16
+#define FSBOOT_PATH_LEN		64
+#define FSBOOT_CONFIG_DELIM	" \t\r"
+
+struct fsboot_entry {
+	char name[FSBOOT_NAME_LEN];
+	char path[FSBOOT_PATH_LEN];
+	enum rproc_mode rproc_mode;
+};
+
+struct fsboot_config {
+	struct fsboot_entry entries[FSBOOT_MAX_ENTRIES];
+	int count;
+	int def;
+	int fallback;
+	unsigned int tries;
+};
+
+static struct fsboot_config fsboot_config;
+
+static int fsboot_config_find(const char *name)
+{
+	int i;
+	for (i = 0; i < fsboot_config.count; ++i)
+		if (strcmp(fsboot_config.entries[i].name, name) == 0)
+			return i;
+
+	return -1;
+}
+
+static void fsboot_config_add(char *name, char **save)
+{
+	struct fsboot_entry *e = &fsboot_config.entries[fsboot_config.count];
+	char *path = strtok_r(NULL, FSBOOT_CONFIG_DELIM, save);
+	char *mode = strtok_r(NULL, FSBOOT_CONFIG_DELIM, save);
+
+	if (!path) {
+		dprintf(CRITICAL, "fs-boot: No image for entry %s\n", name);
+		return;
+	}
+
+	if (fsboot_config.count == FSBOOT_MAX_ENTRIES) {
+		dprintf(CRITICAL, "fs-boot: Too many entries, ignoring %s\n", name);
+		return;
+	}
+
+	while (*path == '/')
+		path++;
+
+	strlcpy(e->name, name, sizeof(e->name));
+	strlcpy(e->path, path, sizeof(e->path));
+	e->rproc_mode = mode ? fsboot_parse_rproc_mode(mode) : RPROC_MODE_UNKNOWN;
+	fsboot_config.count++;
+}
+
+/* Parse the boot config of the mounted partition */
+static bool fsboot_config_load(const char *dev_name)
+{
+	static char buf[FSBOOT_CONFIG_SIZE + 1];
+	char def[FSBOOT_NAME_LEN] = "", fallback[FSBOOT_NAME_LEN] = "";
+	char *line, *key, *arg, *save_line, *save;
+	ssize_t len;
+
+	len = fs_load_file(FSBOOT_CONFIG_PATH, buf, sizeof(buf));
+	if (len < 0)
+		return false;
+
+	if (len > FSBOOT_CONFIG_SIZE) {
+		dprintf(CRITICAL, "fs-boot: Config on %s is larger than %d bytes\n",
+			dev_name, FSBOOT_CONFIG_SIZE);
+		return false;
+	}
+	buf[len] = 0;
+
+	memset(&fsboot_config, 0, sizeof(fsboot_config));
+
+	for (line = strtok_r(buf, "\n", &save_line); line;
+	     line = strtok_r(NULL, "\n", &save_line)) {
+		key = strtok_r(line, FSBOOT_CONFIG_DELIM, &save);
+		if (!key || key[0] == '#')
+			continue;
+
+		arg = strtok_r(NULL, FSBOOT_CONFIG_DELIM, &save);
+		if (!arg) {
+			dprintf(CRITICAL, "fs-boot: Missing value for %s\n", key);
+			continue;
+		}
+
+		if (strcmp(key, "entry") == 0)
+			fsboot_config_add(arg, &save);
+		else if (strcmp(key, "default") == 0)
+			strlcpy(def, arg, sizeof(def));
+		else if (strcmp(key, "fallback") == 0)
+			strlcpy(fallback, arg, sizeof(fallback));
+		else if (strcmp(key, "tries") == 0)
+			fsboot_config.tries = atoi(arg);
+		else
+			dprintf(CRITICAL, "fs-boot: Unknown config key: %s\n", key);
+	}
+
+	if (!fsboot_config.count) {
+		dprintf(CRITICAL, "fs-boot: No entries in config on %s\n", dev_name);
+		return false;
+	}
+
+	fsboot_config.def = def[0] ? fsboot_config_find(def) : 0;
+	if (fsboot_config.def < 0) {
+		dprintf(CRITICAL, "fs-boot: Unknown default entry: %s\n", def);
+		fsboot_config.def = 0;
+	}
+
+	fsboot_config.fallback = fallback[0] ? fsboot_config_find(fallback) : -1;
+	if (fallback[0] && fsboot_config.fallback < 0)
+		dprintf(CRITICAL, "fs-boot: Unknown fallback entry: %s\n", fallback);
+
+	dprintf(INFO, "fs-boot: Config on %s: %d entries, default %s\n", dev_name,
+		fsboot_config.count, fsboot_config.entries[fsboot_config.def].name);
+	return true;
+}
+
+#if LK2ND_FSBOOT_STATE
+#ifndef LK2ND_FSBOOT_STATE_OFFSET
+#define LK2ND_FSBOOT_STATE_OFFSET	0
+#endif
+
+#define FSBOOT_STATE_MAGIC	0x53464b4c	/* "LKFS" */
+
+/* One block on LK2ND_FSBOOT_STATE_PARTITION, all zero means nothing pending */
+struct fsboot_state {
+	uint32_t magic;
+	char next[FSBOOT_NAME_LEN];	/* entry picked for the next boot */
+	uint32_t tries;			/* unconfirmed boots of the default */
+	uint32_t crc;
+};
+
+static uint32_t fsboot_state_crc(const struct fsboot_state *state)
+{
+	return crc32(0, (const unsigned char *)state,
+		     sizeof(*state) - sizeof(state->crc));
+}
+
+static unsigned long long fsboot_state_locate(void)
+{
+	uint32_t block_size = mmc_get_device_blocksize();
+	unsigned long long offset;
+	int index;
+
+	index = partition_get_index(LK2ND_FSBOOT_STATE_PARTITION);
+	if (index == INVALID_PTN) {
+		dprintf(CRITICAL, "fs-boot: No %s partition for the boot state\n",
+			LK2ND_FSBOOT_STATE_PARTITION);
+		return 0;
+	}
+
+	offset = partition_get_offset(index);
+	if (!offset || !block_size || sizeof(struct fsboot_state) > block_size ||
+	    partition_get_size(index) < LK2ND_FSBOOT_STATE_OFFSET + block_size)
+		return 0;
+
+	return offset + LK2ND_FSBOOT_STATE_OFFSET;
+}
+
+static bool fsboot_state_read(struct fsboot_state *state)
+{
+	uint32_t block_size = mmc_get_device_blocksize();
+	unsigned long long offset = fsboot_state_locate();
+	STACKBUF_DMA_ALIGN(buf, block_size);
+
+	if (!offset || mmc_read(offset, (uint32_t *)buf, block_size))
+		return false;
+
+	memcpy(state, buf, sizeof(*state));
+	if (state->magic != FSBOOT_STATE_MAGIC || state->crc != fsboot_state_crc(state)) {
+		memset(state, 0, sizeof(*state));
+		state->magic = FSBOOT_STATE_MAGIC;
+	}
+	state->next[sizeof(state->next) - 1] = 0;
+
+	return true;
+}
+
+static int fsboot_state_write(struct fsboot_state *state)
+{
+	uint32_t block_size = mmc_get_device_blocksize();
+	unsigned long long offset = fsboot_state_locate();
+	STACKBUF_DMA_ALIGN(buf, block_size);
+
+	if (!offset)
+		return -1;
+
+	state->crc = fsboot_state_crc(state);
+	memset(buf, 0, block_size);
+	memcpy(buf, state, sizeof(*state));
+
+	if (mmc_write(offset, block_size, buf)) {
+		dprintf(CRITICAL, "fs-boot: Failed to save the boot state\n");
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
+#if LK2ND_FSBOOT_STATE
+/* Read when picking the entry, only updated once an image was loaded */
+static struct fsboot_state fsboot_state;
+static bool fsboot_state_valid;
+#endif
+
+/* Pick the entry to boot */
+static int fsboot_config_pick(void)
+{
+	int entry = fsboot_config.def;
+#if LK2ND_FSBOOT_STATE
+	int next;
+
+	fsboot_state_valid = fsboot_state_read(&fsboot_state);
+	if (!fsboot_state_valid)
+		return entry;
+
+	if (fsboot_state.next[0]) {
+		next = fsboot_config_find(fsboot_state.next);
+		if (next >= 0) {
+			dprintf(INFO, "fs-boot: Booting %s once\n", fsboot_state.next);
+			entry = next;
+		}
+	} else if (fsboot_config.tries && fsboot_config.fallback >= 0 &&
+		   fsboot_state.tries >= fsboot_config.tries) {
+		dprintf(CRITICAL, "fs-boot: %s was not confirmed after %u boots, booting %s\n",
+			fsboot_config.entries[entry].name, fsboot_state.tries,
+			fsboot_config.entries[fsboot_config.fallback].name);
+		return fsboot_config.fallback;
+	}
+#endif
+	return entry;
+}
+
+/* Count the boot of the entry that was loaded */
+static void fsboot_config_count(int entry)
+{
+#if LK2ND_FSBOOT_STATE
+	if (!fsboot_state_valid)
+		return;
+
+	if (fsboot_state.next[0])
+		memset(fsboot_state.next, 0, sizeof(fsboot_state.next));
+	else if (entry == fsboot_config.def && fsboot_config.tries &&
+		 fsboot_config.fallback >= 0)
+		fsboot_state.tries++;
+	else
+		return;
+
+	fsboot_state_write(&fsboot_state);
+	fsboot_state_valid = false;
+#endif
+}
+
+static int fsboot_config_load_entry(const char *dev_name, int entry,
+				    void *target, size_t sz)
+{
+	struct fsboot_entry *e = &fsboot_config.entries[entry];
+	char image_path[FSBOOT_PATH_LEN + 8] = "/mnt/";
+	int ret;
+
+	strlcat(image_path, e->path, sizeof(image_path));
+	dprintf(INFO, "Found boot entry %s: %s : %s\n", e->name, dev_name, image_path);
+
+	ret = fs_load_file(image_path, target, sz);
+	if (ret < 0) {
+		dprintf(CRITICAL, "fs-boot: Failed to load %s: %d\n", image_path, ret);
+		return ret;
+	}
+
+#if LK2ND_BOOT_HISTORY
+	lk2nd_boot_history_set_source(dev_name);
+#endif
+
+	if (!fs_boot_data.dev) {
+		fs_boot_data.rproc_mode = e->rproc_mode;
+		dprintf(INFO, "Boot partition rproc mode: %d\n", fs_boot_data.rproc_mode);
+	}
+
+	return ret;
+}
+
+/* Boot the picked entry, or the fallback and default one if it fails to load */
+static int fsboot_config_boot(const char *dev_name, void *target, size_t sz)
+{
+	int entries[] = {
+		fsboot_config_pick(), fsboot_config.fallback, fsboot_config.def
+	};
+	unsigned int tried = 0;
+	int i, ret = -1;
+
+	for (i = 0; i < ARRAY_SIZE(entries); ++i) {
+		if (entries[i] < 0 || (tried & (1U << entries[i])))
+			continue;
+		tried |= 1U << entries[i];
+
+		ret = fsboot_config_load_entry(dev_name, entries[i], target, sz);
+		if (ret >= 0) {
+			fsboot_config_count(entries[i]);
+			return ret;
+		}
+	}
+
+	return ret;
+}
+
+/* Entries of the boot config that can be picked for the next boot */
+int fsboot_entry_count(void)
+{
+#if LK2ND_FSBOOT_STATE
+	return fsboot_config.count;
+#else
+	return 0;
+#endif
+}
+
+const char *fsboot_entry_name(int entry)
+{
+	if (entry < 0 || entry >= fsboot_config.count)
+		return NULL;
+
+	return fsboot_config.entries[entry].name;
+}
+
+int fsboot_select_entry(int entry)
+{
+#if LK2ND_FSBOOT_STATE
+	struct fsboot_state state;
+	int ret = -1;
+
+	if (entry < 0 || entry >= fsboot_config.count)
+		return -1;
+
+	/* Called from the menu, keep fastboot commands off the storage */
+	fastboot_lock();
+#if LK2ND_SCRUB
+	lk2nd_scrub_pause();
+#endif
+
+	if (fsboot_state_read(&state)) {
+		strlcpy(state.next, fsboot_config.entries[entry].name,
+			sizeof(state.next));
+		ret = fsboot_state_write(&state);
+	}
+
+#if LK2ND_SCRUB
+	lk2nd_scrub_resume();
+#endif
+	fastboot_unlock();
+
+	if (ret)
+		dprintf(CRITICAL, "fs-boot: Failed to pick %s for the next boot\n",
+			fsboot_config.entries[entry].name);
+	return ret;
+#else
+	return -1;
+#endif
 }
 
 /* Only iterate through files if target is NULL */
@@ -68,9 +647,22 @@ static int fsboot_fs_load_img(char *dev_name, void* target, size_t sz)
 	int ret = -1;
 	bool path_valid = false;
 
+	if (!fsboot_probe(dev_name))
+		return -1;
+
 	if (fs_mount("/mnt", "ext2", dev_name) < 0)
 		return -1;
 
+	/* A boot config replaces the search for boot.img and the marker files */
+	if (target && fsboot_config_load(dev_name)) {
+		ret = fsboot_config_boot(dev_name, target, sz);
+		goto out;
+	}
+
+	/* Keep the first config for the menu */
+	if (!target && !fsboot_config.count)
+		fsboot_config_load(dev_name);
+
 	ret = fs_open_dir("/mnt", &dirh);
 	if (ret < 0) {
 		dprintf(SPEW, "fs_open_dir ret = %d\n", ret);
@@ -95,6 +687,11 @@ static int fsboot_fs_load_img(char *dev_name, void* target, size_t sz)
 	if (target && path_valid)
 		ret = fs_load_file(image_path, target, sz);
 
+#if LK2ND_BOOT_HISTORY
+	if (target && path_valid && ret >= 0)
+		lk2nd_boot_history_set_source(dev_name);
+#endif
+
 	if (ret >= 0 && path_valid && !fs_boot_data.dev) {
 		fs_boot_data.rproc_mode = fsboot_load_rproc_mode("/mnt/lk2nd_rproc_mode");
 		dprintf(INFO, "Boot partition rproc mode: %d\n", fs_boot_data.rproc_mode);
@@ -113,6 +710,10 @@ static int fsboot_find_and_boot(int bdev_id, void* target, size_t sz)
 	bool is_gpt = false;
 
 
+	/* Pick up a card that was inserted or removed in the meantime */
+	if (bdev_id == FS_BOOT_DEV_SDCARD && target_sdcard_update())
+		fsboot_probe_reset();
+
 	sprintf(dev_name, "hd%d", bdev_id);
 	dev = bio_open(dev_name);
 	if (!dev) {
@@ -178,6 +779,41 @@ static int fsboot_find_and_boot(int bdev_id, void* target, size_t sz)
 	return -1;
 }
 
+#if MMC_SDHCI_SUPPORT
+/*
+ * Add the ext2 superblock of every eMMC partition that fsboot_find_and_boot()
+ * will probe to the ranges, so that probing them hits the mmc prefetch cache.
+ */
+int fsboot_prefetch_ranges(struct mmc_prefetch_range *ranges, int max)
+{
+	struct partition_entry *ptn = partition_get_partition_entries();
+	unsigned ptn_count = partition_get_partition_count();
+	uint32_t block_size = mmc_get_device_blocksize();
+	unsigned long long offset;
+	unsigned i;
+	int count = 0;
+
+	if (!ptn || !block_size || block_size > 1024)
+		return 0;
+
+	for (i = 0; i < ptn_count && count < max; ++i) {
+		if (!fsboot_bootable_part((char *)ptn[i].name) ||
+		    fsboot_reject_type(ptn[i].type_guid, ptn[i].dtype))
+			continue;
+
+		offset = ptn[i].first_lba * block_size;
+		if (!offset || ptn[i].size * block_size < 2048)
+			continue;
+
+		ranges[count].blk_addr = (offset + 1024) / block_size;
+		ranges[count].num_blocks = 1024 / block_size;
+		count++;
+	}
+
+	return count;
+}
+#endif
+
 void fsboot_test(void)
 {
 	dprintf(SPEW, "fs-boot: Scanned devices:\n");
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <arch/defines.h>
+#include <arch/ops.h>
+#include <debug.h>
+#include <dma.h>
+#include <kernel/thread.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+/*
+ * Above this size, cleaning the whole cache by set/way is much faster than
+ * walking the range line by line (the caches are only a few hundred KiB).
+ */
+#ifndef DMA_WHOLE_CACHE_THRESHOLD
+#define DMA_WHOLE_CACHE_THRESHOLD	(2 * 1024 * 1024)
+#endif
+
+#define DMA_CLEAN_MAX_RANGES	4
+
+struct dma_range {
+	addr_t start;
+	addr_t end;
+};
+
+static struct dma_range clean_ranges[DMA_CLEAN_MAX_RANGES];
+static unsigned int clean_next;
+
+static bool dma_is_clean(addr_t start, addr_t end)
+{
+	struct dma_range *r;
+	bool clean = false;
+
+	enter_critical_section();
+	for (r = clean_ranges; r < clean_ranges + DMA_CLEAN_MAX_RANGES; r++) {
+		if (r->start < r->end && start >= r->start && end <= r->end) {
+			clean = true;
+			break;
+		}
+	}
+	exit_critical_section();
+
+	return clean;
+}
+
+void dma_mark_clean(const void *buf, size_t len)
+{
+	addr_t start = ROUNDUP((addr_t)buf, CACHE_LINE);
+	addr_t end = ROUNDDOWN((addr_t)buf + len, CACHE_LINE);
+	struct dma_range *r;
+
+	/* Partial cache lines may be shared with data written by the CPU */
+	if (start >= end)
+		return;
+
+	enter_critical_section();
+	for (r = clean_ranges; r < clean_ranges + DMA_CLEAN_MAX_RANGES; r++) {
+		if (r->start < r->end && start <= r->end && end >= r->start) {
+			r->start = MIN(r->start, start);
+			r->end = MAX(r->end, end);
+			goto out;
+		}
+	}
+
+	r = &clean_ranges[clean_next];
+	clean_next = (clean_next + 1) % DMA_CLEAN_MAX_RANGES;
+	r->start = start;
+	r->end = end;
+out:
+	exit_critical_section();
+}
+
+void dma_forget(const void *buf, size_t len)
+{
+	addr_t start = (addr_t)buf, end = start + len;
+	struct dma_range *r;
+
+	enter_critical_section();
+	for (r = clean_ranges; r < clean_ranges + DMA_CLEAN_MAX_RANGES; r++)
+		if (start < r->end && end > r->start)
+			r->start = r->end = 0;
+	exit_critical_section();
+}
+
+static void dma_clean(addr_t start, size_t len)
+{
+#if ARM_CPU_CORTEX_A8
+	if (len >= DMA_WHOLE_CACHE_THRESHOLD) {
+		arch_clean_invalidate_cache();
+		return;
+	}
+#endif
+	arch_clean_cache_range(start, len);
+}
+
+static void dma_clean_invalidate(addr_t start, size_t len)
+{
+#if ARM_CPU_CORTEX_A8
+	if (len >= DMA_WHOLE_CACHE_THRESHOLD) {
+		arch_clean_invalidate_cache();
+		return;
+	}
+#endif
+	arch_clean_invalidate_cache_range(start, len);
+}
+
+void dma_map(const void *buf, size_t len, enum dma_data_direction dir)
+{
+	addr_t start = (addr_t)buf;
+
+	/* Nothing dirty in the cache that could be written back over the data */
+	if (dma_is_clean(start, start + len))
+		return;
+
+	if (dir == DMA_TO_DEVICE)
+		dma_clean(start, len);
+	else
+		dma_clean_invalidate(start, len);
+}
+
+void dma_unmap(const void *buf, size_t len, enum dma_data_direction dir)
+{
+	addr_t start = (addr_t)buf;
+
+	if (dir == DMA_TO_DEVICE)
+		return;
+
+	/*
+	 * Drop lines that were (speculatively) loaded during the transfer.
+	 * The CPU did not write to the buffer, so the whole cache can be
+	 * cleaned without writing anything back over the received data.
+	 */
+#if ARM_CPU_CORTEX_A8
+	if (len >= DMA_WHOLE_CACHE_THRESHOLD) {
+		arch_clean_invalidate_cache();
+		return;
+	}
+#endif
+	arch_invalidate_cache_range(start, len);
+}
+
+void *dma_alloc_coherent(size_t size)
+{
+	return memalign(CACHE_LINE, ROUNDUP(size, CACHE_LINE));
+}
+
+void dma_free_coherent(void *ptr)
+{
+	free(ptr);
+}
+
+void dma_sync_for_device(const void *ptr, size_t size)
+{
+	arch_clean_cache_range((addr_t)ptr, size);
+}
+
+void dma_sync_for_cpu(const void *ptr, size_t size)
+{
+	arch_invalidate_cache_range((addr_t)ptr, size);
+}
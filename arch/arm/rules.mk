@@ -91,6 +91,7 @@ OBJS += \
 	$(LOCAL_DIR)/asm.o \
 	$(LOCAL_DIR)/cache.o \
 	$(LOCAL_DIR)/cache-ops.o \
+	$(LOCAL_DIR)/dma.o \
 	$(LOCAL_DIR)/ops.o \
 	$(LOCAL_DIR)/exceptions.o \
 	$(LOCAL_DIR)/faults.o \
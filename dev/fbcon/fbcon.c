@@ -36,6 +36,11 @@
 #include <platform.h>
 #include <string.h>
 #include <arch/ops.h>
+#include <dma.h>
+#include <kernel/thread.h>
+#if FBCON_DISPLAY_MSG
+#include <display_menu.h>
+#endif
 
 #include "font5x12.h"
 
@@ -82,6 +87,15 @@ static uint32_t			SELECT_BGCOLOR;
 
 static struct pos		cur_pos;
 static struct pos		max_pos;
+
+/* Pixel lines modified since the last flush, empty if start >= end */
+static struct {
+	unsigned start;
+	unsigned end;
+} dirty;
+
+static unsigned			update_depth;
+static void			*shown_base;
 static struct fb_color		*fb_color_formats;
 static struct fb_color		fb_color_formats_555[] = {
 					[FBCON_COMMON_MSG] = {RGB565_WHITE, RGB565_BLACK},
@@ -172,6 +186,32 @@ static void fbcon_drawglyph(char *pixels, uint32_t paint, unsigned stride,
 
 }
 
+static void fbcon_mark_dirty(unsigned y, unsigned height)
+{
+	unsigned end = y + height;
+
+	if (end > config->height)
+		end = config->height;
+	if (y >= end)
+		return;
+
+	if (dirty.start >= dirty.end) {
+		dirty.start = y;
+		dirty.end = end;
+		return;
+	}
+
+	if (y < dirty.start)
+		dirty.start = y;
+	if (end > dirty.end)
+		dirty.end = end;
+}
+
+static void fbcon_mark_dirty_all(void)
+{
+	fbcon_mark_dirty(0, config->height);
+}
+
 void fbcon_draw_msg_background(unsigned y_start, unsigned y_end,
 	uint32_t old_paint, int update)
 {
@@ -208,22 +248,100 @@ void fbcon_draw_msg_background(unsigned y_start, unsigned y_end,
 			pixels += config->bpp / 8;
 		}
 	}
+
+	fbcon_mark_dirty(y_start * FONT_HEIGHT, (y_end - y_start) * FONT_HEIGHT);
 }
 
 static void fbcon_flush(void)
 {
-	unsigned total_x, total_y;
-	unsigned bytes_per_bpp;
+	unsigned line_bytes, start, size, lines_start, lines;
+	void *front;
+
+	if (update_depth || dirty.start >= dirty.end)
+		return;
+
+	line_bytes = config->width * (config->bpp / 8);
+	lines_start = dirty.start;
+	lines = dirty.end - dirty.start;
+	start = lines_start * line_bytes;
+	size = lines * line_bytes;
+	dirty.start = dirty.end = 0;
+
+	/* Only the lines drawn since the last flush need to reach memory */
+	dma_map((char *)config->base + start, size, DMA_TO_DEVICE);
+
+	if (config->flip && config->back) {
+		front = config->base;
+		config->flip(front);
+		config->base = config->back;
+		config->back = front;
+	}
+	else if (config->flip && config->scroll_base && config->base != shown_base) {
+		config->flip(config->base);
+		shown_base = config->base;
+	}
 
 	if (config->update_start)
 		config->update_start();
 	if (config->update_done)
 		while (!config->update_done());
 
-	total_x = config->width;
-	total_y = config->height;
-	bytes_per_bpp = ((config->bpp) / 8);
-	arch_clean_invalidate_cache_range((addr_t) config->base, (total_x * total_y * bytes_per_bpp));
+	/*
+	 * The new off-screen buffer still holds the previous frame.
+	 * Bring it up to date by copying the lines that have just changed,
+	 * they need to be flushed along with the next frame.
+	 */
+	if (config->flip && config->back) {
+		memcpy((uint8_t*) config->base + start,
+		       (uint8_t*) config->back + start, size);
+		fbcon_mark_dirty(lines_start, lines);
+	}
+}
+
+/*
+ * Collect all drawing until the matching fbcon_update_end() into a single
+ * frame, so it is flushed (or flipped on screen) only once at the end.
+ */
+void fbcon_update_begin(void)
+{
+	update_depth++;
+}
+
+void fbcon_update_end(void)
+{
+	ASSERT(update_depth);
+
+	if (--update_depth == 0 && config)
+		fbcon_flush();
+}
+
+/*
+ * Scroll by moving the visible window down inside the scroll buffer.
+ * Only the newly exposed lines need to be cleared, the pixels are moved
+ * back to the start of the buffer once the window reaches its end.
+ */
+static void fbcon_scroll_pan(unsigned lines)
+{
+	unsigned line_bytes = config->width * (config->bpp / 8);
+	unsigned top = ((uint8_t*) config->base - (uint8_t*) config->scroll_base) / line_bytes;
+	uint8_t *src = (uint8_t*) config->base + lines * line_bytes;
+
+	if (top + lines + config->height > config->scroll_height) {
+		memmove(config->scroll_base, src, (config->height - lines) * line_bytes);
+		config->base = config->scroll_base;
+		fbcon_mark_dirty_all();
+	} else {
+		config->base = src;
+
+		/* Dirty lines moved up together with the window */
+		dirty.start = (dirty.start > lines) ? dirty.start - lines : 0;
+		dirty.end = (dirty.end > lines) ? dirty.end - lines : 0;
+	}
+
+	memset((uint8_t*) config->base + (config->height - lines) * line_bytes,
+	       BGCOLOR, lines * line_bytes);
+	fbcon_mark_dirty(config->height - lines, lines);
+	fbcon_flush();
 }
 
 /* TODO: Take stride into account */
@@ -237,9 +355,15 @@ static void fbcon_scroll_up(void)
 	uint8_t *src = dst + off_bytes;
 	unsigned count = config->width*config->height*bpp - off_bytes;
 
+	if (config->flip && config->scroll_base) {
+		fbcon_scroll_pan(num_lines * FONT_HEIGHT);
+		return;
+	}
+
 	memmove(dst, src, count);
 	memset(dst+count, BGCOLOR, config->width*config->height*bpp - count);
 
+	fbcon_mark_dirty_all();
 	fbcon_flush();
 }
 
@@ -264,6 +388,7 @@ void fbcon_draw_line(uint32_t type)
 			pixels++;
 		}
 	}
+	fbcon_mark_dirty(cur_pos.y * FONT_HEIGHT, 1);
 
 	cur_pos.y += 1;
 	cur_pos.x = 0;
@@ -298,6 +423,7 @@ void fbcon_clear(void)
 	}
 	cur_pos.x = 0;
 	cur_pos.y = 0;
+	fbcon_mark_dirty_all();
 }
 
 void fbcon_putc_factor(char c, int type, unsigned scale_factor)
@@ -335,6 +461,7 @@ void fbcon_putc_factor(char c, int type, unsigned scale_factor)
 
 	fbcon_drawglyph(pixels, FGCOLOR, config->stride, (config->bpp / 8),
 			font5x12 + (c - 32) * 2, scale_factor);
+	fbcon_mark_dirty(cur_pos.y * FONT_HEIGHT, FONT_HEIGHT * scale_factor);
 
 	cur_pos.x++;
 	if (cur_pos.x >= (int)(max_pos.x / scale_factor))
@@ -388,6 +515,65 @@ uint32_t fbcon_get_current_bg(void)
 	return BGCOLOR;
 }
 
+#if WITH_DEBUG_FBCON && WITH_DEBUG_LOG_BUF
+/* Interval for drawing new log output, about one frame at 30 Hz */
+#define FBCON_LOG_INTERVAL	33
+
+/*
+ * Instead of drawing every character synchronously from dputc(), draw the
+ * new contents of the lk_log ring buffer periodically, as a single frame.
+ */
+static int fbcon_log_thread(void *arg)
+{
+	const char *buf = lk_log_getbuf();
+	unsigned max_size = lk_log_getmaxsize();
+	unsigned pos = 0, written;
+
+	while (true) {
+		thread_sleep(FBCON_LOG_INTERVAL);
+
+		written = lk_log_getsize();
+		if (written == pos)
+			continue;
+
+		/* Skip output that was already overwritten in the ring buffer */
+		if (written - pos > max_size)
+			pos = written - max_size;
+
+		/* The menus draw from other threads */
+#if FBCON_DISPLAY_MSG
+		msg_lock_acquire();
+#endif
+		fbcon_update_begin();
+		for (; pos != written; pos++)
+			fbcon_putc(buf[pos % max_size]);
+		fbcon_update_end();
+#if FBCON_DISPLAY_MSG
+		msg_lock_release();
+#endif
+	}
+
+	return 0;
+}
+
+static void fbcon_log_start(void)
+{
+	static thread_t *thr;
+
+	if (thr)
+		return;
+
+	thr = thread_create("fbcon-log", &fbcon_log_thread, NULL,
+			    LOW_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr) {
+		dprintf(CRITICAL, "Failed to create fbcon-log thread\n");
+		return;
+	}
+
+	thread_resume(thr);
+}
+#endif
+
 void fbcon_setup(struct fbcon_config *_config)
 {
 	ASSERT(_config);
@@ -415,10 +601,32 @@ void fbcon_setup(struct fbcon_config *_config)
 	max_pos.x = config->width / (FONT_WIDTH+1);
 	max_pos.y = (config->height - 1) / FONT_HEIGHT;
 
+	/* Start drawing off-screen, with the current screen contents */
+	if (config->flip && config->back) {
+		void *front = config->base;
+
+		memcpy(config->back, front,
+		       config->width * config->height * (config->bpp / 8));
+		config->base = config->back;
+		config->back = front;
+		fbcon_mark_dirty_all();
+	}
+	else if (config->flip && config->scroll_base) {
+		/* Continue with the current screen contents at the top of the scroll buffer */
+		memcpy(config->scroll_base, config->base,
+		       config->width * config->height * (config->bpp / 8));
+		shown_base = config->base;
+		config->base = config->scroll_base;
+		fbcon_mark_dirty_all();
+	}
+
 #if !DISPLAY_SPLASH_SCREEN
 	fbcon_clear();
 #endif
 
+#if WITH_DEBUG_FBCON && WITH_DEBUG_LOG_BUF
+	fbcon_log_start();
+#endif
 }
 
 struct fbcon_config* fbcon_display(void)
@@ -486,6 +694,7 @@ void fbcon_extract_to_screen(logo_img_header *header, void* address)
 		}
 	}
 
+	fbcon_mark_dirty_all();
 }
 
 void display_default_image_on_screen(void)
@@ -545,6 +754,7 @@ void display_image_on_screen(void)
 		display_default_image_on_screen();
 	} else {
 		/* data has been put into the right place */
+		fbcon_mark_dirty_all();
 		fbcon_flush();
 	}
 #else
@@ -280,6 +280,11 @@ void pm8x41_resin_s2_reset_disable()
 }
 
 /* Resin irq status for faulty pmic*/
+static bool pm8x41_resin_bark(void *arg)
+{
+	return REG_READ(PON_INT_RT_STS) & BIT(RESIN_BARK_INT_BIT);
+}
+
 uint32_t pm8x41_v2_resin_status()
 {
 	uint8_t rt_sts = 0;
@@ -287,10 +292,13 @@ uint32_t pm8x41_v2_resin_status()
 	/* Enable S2 reset so we can detect the volume down key press */
 	pm8x41_resin_s2_reset_enable();
 
-	/* Delay before interrupt triggering.
-	 * See PON_DEBOUNCE_CTL reg.
+	/* Wait for the interrupt to trigger, at most 100 ms.
+	 * See PON_DEBOUNCE_CTL reg. The bark only fires when the key is
+	 * pressed, so a timeout is the normal "not pressed" result and
+	 * still takes the full 100 ms.
 	 */
-	mdelay(100);
+	wait_for_cond_quiet("pm8x41 resin bark", pm8x41_resin_bark, NULL,
+			    100000, 1000);
 
 	rt_sts = REG_READ(PON_INT_RT_STS);
 
@@ -55,6 +55,7 @@ void arch_clean_cache_range(addr_t start, size_t len);
 void arch_clean_invalidate_cache_range(addr_t start, size_t len);
 void arch_invalidate_cache_range(addr_t start, size_t len);
 void arch_sync_cache_range(addr_t start, size_t len);
+void arch_clean_invalidate_cache(void);
 void cache_clean_invalidate_unaligned_start_addr(addr_t start, size_t size);
 	
 void arch_idle(void);
@@ -50,17 +50,20 @@ extern "C" {
 /* output */
 void _dputc(char c); // XXX for now, platform implements
 int _dputs(const char *str);
-int _dprintf(const char *fmt, ...) __PRINTFLIKE(1, 2);
+int _dprintf(int level, const char *fmt, ...) __PRINTFLIKE(2, 3);
 int _dvprintf(const char *fmt, va_list ap);
 
 #define dputc(level, str) do { if ((level) <= DEBUGLEVEL) { _dputc(str); } } while (0)
 #define dputs(level, str) do { if ((level) <= DEBUGLEVEL) { _dputs(str); } } while (0)
-#define dprintf(level, x...) do { if ((level) <= DEBUGLEVEL) { _dprintf(x); } } while (0)
+#define dprintf(level, x...) do { if ((level) <= DEBUGLEVEL) { _dprintf(level, x); } } while (0)
 #define dvprintf(level, x...) do { if ((level) <= DEBUGLEVEL) { _dvprintf(x); } } while (0)
 
 /* lk_log */
 char* lk_log_getbuf(void);
 unsigned lk_log_getsize(void);
+unsigned lk_log_getmaxsize(void);
+void lk_log_message(int level, const char *prefix, const char *msg);
+size_t lk_log_read(char *buf, size_t size);
 
 /* input */
 int dgetc(char *c, bool wait);
@@ -102,11 +102,31 @@ struct fbcon_config {
 
 	void		(*update_start)(void);
 	int		(*update_done)(void);
+
+	/*
+	 * Optional double buffering: if both are set, fbcon draws into an
+	 * off-screen buffer and calls flip() to scan it out on every flush.
+	 * base and back are swapped afterwards, so base is always the buffer
+	 * being drawn and back the one currently on screen.
+	 */
+	void		*back;
+	void		(*flip)(void *base);
+
+	/*
+	 * Optional scrolling by panning (instead of double buffering):
+	 * scroll_base has room for scroll_height lines. Scrolling moves base
+	 * down inside it and calls flip() to scan out from the new position,
+	 * so the pixels only need to be moved once the end is reached.
+	 */
+	void		*scroll_base;
+	unsigned	scroll_height;
 };
 
 void fbcon_setup(struct fbcon_config *cfg);
 void fbcon_putc(char c);
 void fbcon_clear(void);
+void fbcon_update_begin(void);
+void fbcon_update_end(void);
 struct fbcon_config* fbcon_display(void);
 void fbcon_extract_to_screen(logo_img_header *header, void* address);
 void fbcon_putc_factor(char c, int type, unsigned scale_factor);
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __DMA_H
+#define __DMA_H
+
+#include <sys/types.h>
+
+enum dma_data_direction {
+	DMA_BIDIRECTIONAL,
+	DMA_TO_DEVICE,
+	DMA_FROM_DEVICE,
+};
+
+/*
+ * Cache maintenance for DMA buffers:
+ *  - dma_map() before the device accesses the buffer,
+ *  - dma_unmap() after the device is done, before the CPU reads it again.
+ */
+void dma_map(const void *buf, size_t len, enum dma_data_direction dir);
+void dma_unmap(const void *buf, size_t len, enum dma_data_direction dir);
+
+/*
+ * Known-clean ranges: the owner of a buffer can declare that it has no
+ * dirty cache lines (e.g. it was just received from a device and the CPU
+ * only reads it), so dma_map() can skip the cache maintenance for it.
+ * The owner must call dma_forget() before the CPU writes to it again.
+ */
+void dma_mark_clean(const void *buf, size_t len);
+void dma_forget(const void *buf, size_t len);
+
+/*
+ * Memory for descriptors shared with a device. Allocations never share
+ * cache lines with other data, so syncing them does not affect anything else.
+ */
+void *dma_alloc_coherent(size_t size);
+void dma_free_coherent(void *ptr);
+void dma_sync_for_device(const void *ptr, size_t size);
+void dma_sync_for_cpu(const void *ptr, size_t size);
+
+#endif
@@ -24,7 +24,17 @@ struct fs_boot_data {
 
 extern struct fs_boot_data fs_boot_data;
 
+struct mmc_prefetch_range;
+
 void fsboot_test(void);
+void fsboot_probe_reset(void);
 int fsboot_boot_first(void* target, size_t sz);
+#if MMC_SDHCI_SUPPORT
+int fsboot_prefetch_ranges(struct mmc_prefetch_range *ranges, int max);
+#endif
+
+int fsboot_entry_count(void);
+const char *fsboot_entry_name(int entry);
+int fsboot_select_entry(int entry);
 
 #endif
@@ -28,6 +28,12 @@
 
 typedef uint32_t bnum_t;
 
+/* one buffer of a vectored (scatter/gather) transfer */
+typedef struct bio_vec {
+	void *buf;
+	size_t len;
+} bio_vec_t;
+
 typedef struct bdev {
 	struct list_node node;
 	volatile int ref;
@@ -40,12 +46,18 @@ typedef struct bdev {
 	char *label;
 	bool is_gpt;
 	bool is_subdev;
+	/* partition type from the parent's table, if known (all zero otherwise) */
+	uint8_t part_type_guid[16];
+	uint8_t part_mbr_type;
 
 	/* function pointers */
 	ssize_t (*read)(struct bdev *, void *buf, off_t offset, size_t len);
 	ssize_t (*read_block)(struct bdev *, void *buf, bnum_t block, uint count);
 	ssize_t (*write)(struct bdev *, const void *buf, off_t offset, size_t len);
 	ssize_t (*write_block)(struct bdev *, const void *buf, bnum_t block, uint count);
+	/* optional, transfer consecutive blocks from/to several buffers at once */
+	ssize_t (*read_blockv)(struct bdev *, const bio_vec_t *vec, uint vec_count, bnum_t block);
+	ssize_t (*write_blockv)(struct bdev *, const bio_vec_t *vec, uint vec_count, bnum_t block);
 	ssize_t (*erase)(struct bdev *, off_t offset, size_t len);
 	int (*ioctl)(struct bdev *, int request, void *argp);
 	void (*close)(struct bdev *);
@@ -58,6 +70,8 @@ ssize_t bio_read(bdev_t *dev, void *buf, off_t offset, size_t len);
 ssize_t bio_read_block(bdev_t *dev, void *buf, bnum_t block, uint count);
 ssize_t bio_write(bdev_t *dev, const void *buf, off_t offset, size_t len);
 ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count);
+ssize_t bio_readv(bdev_t *dev, const bio_vec_t *vec, uint vec_count, off_t offset);
+ssize_t bio_writev(bdev_t *dev, const bio_vec_t *vec, uint vec_count, off_t offset);
 ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len);
 int bio_ioctl(bdev_t *dev, int request, void *argp);
 
@@ -55,6 +55,7 @@ extern struct lk2nd_device lk2nd_dev;
 
 void lk2nd_init(void);
 int lk2nd_fdt_parse_early_uart(void);
+int lk2nd_fdt_parse_sd_cd_gpio(uint8_t *pull, uint8_t *active);
 void lk2nd_target_keystatus();
 char *genlk1st2lk2ndcmdline(void);
 bool lk2nd_cmdline_scan(const char *cmdline, const char *arg);
@@ -64,9 +65,39 @@ void lk2nd_motorola_smem_write_unit_info(const void *fdt, int offset);
 void lk2nd_smd_rpm_hack_opening(const void *fdt, int offset);
 
 void lk2nd_update_device_tree(void *fdt, const char *cmdline, bool arm64);
+
+void lk2nd_mem_reserve(const char *name, uint64_t base, uint64_t size,
+		       const char *user);
+void lk2nd_mem_release(uint64_t base);
+uint64_t lk2nd_mem_limit(uint64_t start, uint64_t end);
+void lk2nd_mem_update_device_tree(void *fdt);
 void lk2nd_rproc_update_dev_tree(void *fdt);
+void lk2nd_cont_splash_update_device_tree(void *fdt);
+
+void lk2nd_boot_history_set_source(const char *source);
+void lk2nd_boot_history_save(void);
+size_t lk2nd_boot_history_dump(char *buf, size_t size);
+
+void lk2nd_profile_start(unsigned int hz);
+void lk2nd_profile_stop(void);
+size_t lk2nd_profile_dump(void *buf, size_t size);
+
+void lk2nd_scrub_start(void);
+void lk2nd_scrub_pause(void);
+void lk2nd_scrub_resume(void);
+size_t lk2nd_scrub_report(char *buf, size_t size);
+
+#define LK2ND_BOOT_CACHE_DIGEST_SIZE	32
+void lk2nd_boot_cache_init(void);
+void lk2nd_boot_cache_clear(void);
+void lk2nd_boot_cache_digest(const void *data, size_t size, uint8_t *digest);
+int lk2nd_boot_cache_put(const void *data, size_t size, uint8_t *digest);
+const void *lk2nd_boot_cache_get(const uint8_t *digest, size_t size);
+void lk2nd_boot_cache_keep(void);
+void lk2nd_boot_cache_update_device_tree(void *fdt);
 
 struct smp_spin_table;
+void smp_spin_table_park(struct smp_spin_table *table, void *fdt);
 void smp_spin_table_setup(struct smp_spin_table *table, void *fdt, bool arm64, bool force);
 
 int lkfdt_prop_strcmp(const void *fdt, int node, const char *prop, const char *cmp);
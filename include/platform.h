@@ -32,6 +32,7 @@
 
 time_t current_time(void);
 bigtime_t current_time_hires(void);
+uint32_t platform_get_sclk_count(void);
 
 /* super early platform initialization, before almost everything */
 void platform_early_init(void);
@@ -43,6 +44,7 @@ void platform_init(void);
 int platform_use_identity_mmu_mappings(void);
 void platform_init_mmu_mappings(void);
 addr_t platform_map_fb(addr_t phys_addr, uint32_t size);
+void platform_map_scratch(uint32_t size);
 addr_t platform_get_virt_to_phys_mapping(addr_t virt_addr);
 addr_t platform_get_phys_to_virt_mapping(addr_t phys_addr);
 
@@ -30,6 +30,21 @@ status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg
 void mdelay(unsigned msecs);
 void udelay(unsigned usecs);
 
+/*
+ * Poll cond(arg) every poll_us until it returns true, for at most timeout_us.
+ * Returns NO_ERROR or ERR_TIMED_OUT. The time the wait actually took is logged
+ * with the given name.
+ */
+status_t wait_for_cond(const char *name, bool (*cond)(void *arg), void *arg,
+		       unsigned timeout_us, unsigned poll_us);
+
+/*
+ * Same as wait_for_cond(), for conditions where a timeout is an expected
+ * result rather than an error. Timeouts are only logged at SPEW.
+ */
+status_t wait_for_cond_quiet(const char *name, bool (*cond)(void *arg),
+			     void *arg, unsigned timeout_us, unsigned poll_us);
+
 uint32_t platform_tick_rate(void);
 
 
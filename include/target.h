@@ -58,6 +58,7 @@ void target_serialno(unsigned char *buf);
 void target_fastboot_init(void);
 void target_load_ssd_keystore(void);
 void *target_mmc_device();
+bool target_sdcard_update(void);
 uint32_t is_user_force_reset(void);
 
 bool target_display_panel_node(char *panel_name, char *pbuf,
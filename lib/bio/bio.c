@@ -37,6 +37,55 @@ struct bdev_struct {
 
 static struct bdev_struct *bdevs;
 
+/*
+ * read with unaligned start and/or end in a single request, the partial blocks
+ * go to temporary buffers and the middle directly to the destination
+ */
+static ssize_t bio_default_read_vectored(struct bdev *dev, void *_buf, off_t offset, size_t len)
+{
+	uint8_t *buf = (uint8_t *)_buf;
+	size_t block_offset = offset % dev->block_size;
+	size_t head = 0, tail = 0;
+	bio_vec_t vec[3];
+	uint vec_count = 0;
+	ssize_t err;
+	STACKBUF_DMA_ALIGN(head_temp, dev->block_size);
+	STACKBUF_DMA_ALIGN(tail_temp, dev->block_size);
+
+	if (block_offset) {
+		head = MIN(dev->block_size - block_offset, len);
+		vec[vec_count].buf = head_temp;
+		vec[vec_count].len = dev->block_size;
+		vec_count++;
+	}
+
+	tail = (len - head) % dev->block_size;
+	if (len - head - tail) {
+		vec[vec_count].buf = buf + head;
+		vec[vec_count].len = len - head - tail;
+		vec_count++;
+	}
+
+	if (tail) {
+		vec[vec_count].buf = tail_temp;
+		vec[vec_count].len = dev->block_size;
+		vec_count++;
+	}
+
+	LTRACEF("buf %p, offset %lld, len %zd, head %zd, tail %zd\n", buf, offset, len, head, tail);
+
+	err = dev->read_blockv(dev, vec, vec_count, offset / dev->block_size);
+	if (err < 0)
+		return err;
+
+	if (head)
+		memcpy(buf, head_temp + block_offset, head);
+	if (tail)
+		memcpy(buf + len - tail, tail_temp, tail);
+
+	return len;
+}
+
 /* default implementation is to use the read_block hook to 'deblock' the device */
 static ssize_t bio_default_read(struct bdev *dev, void *_buf, off_t offset, size_t len)
 {
@@ -46,6 +95,10 @@ static ssize_t bio_default_read(struct bdev *dev, void *_buf, off_t offset, size
 	int err = 0;
 	STACKBUF_DMA_ALIGN(temp, dev->block_size); // temporary buffer for partial block transfers
 
+	/* avoid separate requests for the partial blocks if the device can */
+	if (dev->read_blockv && ((offset % dev->block_size) || (len % dev->block_size)))
+		return bio_default_read_vectored(dev, _buf, offset, len);
+
 	/* find the starting block */
 	block = offset / dev->block_size;
 
@@ -345,6 +398,82 @@ ssize_t bio_write_block(bdev_t *dev, const void *buf, bnum_t block, uint count)
 	return dev->write_block(dev, buf, block, count);
 }
 
+static bool bio_vec_is_aligned(bdev_t *dev, const bio_vec_t *vec, uint vec_count, off_t offset, size_t *len)
+{
+	uint i;
+
+	*len = 0;
+	for (i = 0; i < vec_count; i++) {
+		if (vec[i].len % dev->block_size)
+			return false;
+		*len += vec[i].len;
+	}
+
+	return (offset % dev->block_size) == 0 && offset + *len <= dev->size;
+}
+
+ssize_t bio_readv(bdev_t *dev, const bio_vec_t *vec, uint vec_count, off_t offset)
+{
+	ssize_t bytes_read = 0, err;
+	size_t len;
+	uint i;
+
+	LTRACEF("dev '%s', vec_count %u, offset %lld\n", dev->name, vec_count, offset);
+
+	DEBUG_ASSERT(dev->ref > 0);
+
+	if (offset < 0)
+		return -1;
+
+	/* block aligned buffers can be read with a single request */
+	if (dev->read_blockv && bio_vec_is_aligned(dev, vec, vec_count, offset, &len) && len)
+		return dev->read_blockv(dev, vec, vec_count, offset / dev->block_size);
+
+	for (i = 0; i < vec_count; i++) {
+		err = bio_read(dev, vec[i].buf, offset, vec[i].len);
+		if (err < 0)
+			return err;
+
+		bytes_read += err;
+		offset += err;
+		if ((size_t)err < vec[i].len)
+			break;
+	}
+
+	return bytes_read;
+}
+
+ssize_t bio_writev(bdev_t *dev, const bio_vec_t *vec, uint vec_count, off_t offset)
+{
+	ssize_t bytes_written = 0, err;
+	size_t len;
+	uint i;
+
+	LTRACEF("dev '%s', vec_count %u, offset %lld\n", dev->name, vec_count, offset);
+
+	DEBUG_ASSERT(dev->ref > 0);
+
+	if (offset < 0)
+		return -1;
+
+	/* block aligned buffers can be written with a single request */
+	if (dev->write_blockv && bio_vec_is_aligned(dev, vec, vec_count, offset, &len) && len)
+		return dev->write_blockv(dev, vec, vec_count, offset / dev->block_size);
+
+	for (i = 0; i < vec_count; i++) {
+		err = bio_write(dev, vec[i].buf, offset, vec[i].len);
+		if (err < 0)
+			return err;
+
+		bytes_written += err;
+		offset += err;
+		if ((size_t)err < vec[i].len)
+			break;
+	}
+
+	return bytes_written;
+}
+
 ssize_t bio_erase(bdev_t *dev, off_t offset, size_t len)
 {
 	LTRACEF("dev '%s', offset %lld, len %zd\n", dev->name, offset, len);
@@ -390,12 +519,16 @@ void bio_initialize_bdev(bdev_t *dev, const char *name, size_t block_size, bnum_
 	dev->label = NULL;
 	dev->is_gpt = false;
 	dev->is_subdev = false;
+	memset(dev->part_type_guid, 0, sizeof(dev->part_type_guid));
+	dev->part_mbr_type = 0;
 
 	/* set up the default hooks, the sub driver should override the block operations at least */
 	dev->read = bio_default_read;
 	dev->read_block = bio_default_read_block;
 	dev->write = bio_default_write;
 	dev->write_block = bio_default_write_block;
+	dev->read_blockv = NULL;
+	dev->write_blockv = NULL;
 	dev->erase = bio_default_erase;
 	dev->close = NULL;
 }
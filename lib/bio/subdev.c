@@ -51,6 +51,13 @@ static ssize_t subdev_read_block(struct bdev *_dev, void *buf, bnum_t block, uin
 	return bio_read_block(subdev->parent, buf, block + subdev->offset, count);
 }
 
+static ssize_t subdev_read_blockv(struct bdev *_dev, const bio_vec_t *vec, uint vec_count, bnum_t block)
+{
+	subdev_t *subdev = (subdev_t *)_dev;
+
+	return subdev->parent->read_blockv(subdev->parent, vec, vec_count, block + subdev->offset);
+}
+
 static ssize_t subdev_write(struct bdev *_dev, const void *buf, off_t offset, size_t len)
 {
 	subdev_t *subdev = (subdev_t *)_dev;
@@ -65,6 +72,13 @@ static ssize_t subdev_write_block(struct bdev *_dev, const void *buf, bnum_t blo
 	return bio_write_block(subdev->parent, buf, block + subdev->offset, count);
 }
 
+static ssize_t subdev_write_blockv(struct bdev *_dev, const bio_vec_t *vec, uint vec_count, bnum_t block)
+{
+	subdev_t *subdev = (subdev_t *)_dev;
+
+	return subdev->parent->write_blockv(subdev->parent, vec, vec_count, block + subdev->offset);
+}
+
 static ssize_t subdev_erase(struct bdev *_dev, off_t offset, size_t len)
 {
 	subdev_t *subdev = (subdev_t *)_dev;
@@ -102,6 +116,10 @@ status_t bio_publish_subdevice(const char *parent_dev, const char *subdev, bnum_
 	sub->dev.read_block = &subdev_read_block;
 	sub->dev.write = &subdev_write;
 	sub->dev.write_block = &subdev_write_block;
+	if (parent->read_blockv)
+		sub->dev.read_blockv = &subdev_read_blockv;
+	if (parent->write_blockv)
+		sub->dev.write_blockv = &subdev_write_blockv;
 	sub->dev.erase = &subdev_erase;
 	sub->dev.close = &subdev_close;
 
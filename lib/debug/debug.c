@@ -77,21 +77,26 @@ int _dputs(const char *str)
 	return 0;
 }
 
-int _dprintf(const char *fmt, ...)
+int _dprintf(int level, const char *fmt, ...)
 {
 	char buf[256];
 	char ts_buf[13];
 	int err;
 
 	snprintf(ts_buf, sizeof(ts_buf), "[%u] ", current_time());
-	dputs(ALWAYS, ts_buf);
 
 	va_list ap;
 	va_start(ap, fmt);
 	err = vsnprintf(buf, sizeof(buf), fmt, ap);
 	va_end(ap);
 
+#if WITH_DEBUG_LOG_BUF
+	/* Kept in one piece with its level in the log */
+	lk_log_message(level, ts_buf, buf);
+#else
+	dputs(ALWAYS, ts_buf);
 	dputs(ALWAYS, buf);
+#endif
 	return err;
 }
 
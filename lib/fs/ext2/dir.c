@@ -189,6 +189,13 @@ int ext2_lookup(ext2_t *ext2, const char *_path, inodenum_t *inum)
 {
     LTRACEF("path '%s', inum %p\n", _path, inum);
 
+    /* the root inode is only loaded once something is looked up */
+    if (ext2->root_inode.i_mode == 0) {
+        int err = ext2_load_inode(ext2, EXT2_ROOT_INO, &ext2->root_inode);
+        if (err < 0)
+            return err;
+    }
+
     char path[512];
     strlcpy(path, _path, sizeof(path));
 
@@ -236,12 +243,20 @@ status_t ext2_read_directory(dircookie *dircookie, struct dirent *ent) {
 
 	ext2_dir_t *dir = (ext2_dir_t *)dircookie;
 
-	if (dir->offset >= dir->length)
-		return ERR_NOT_FOUND;
+	/* skip unused entries, e.g. the checksum tail with metadata_csum */
+	do {
+		if (dir->offset >= dir->length)
+			return ERR_NOT_FOUND;
 
-	ret = ext2_read_inode(dir->file->ext2, &dir->file->inode, &direntry, dir->offset, sizeof(struct ext2_dir_entry_2));
-	if (ret < 0)
-		return ret;
+		ret = ext2_read_inode(dir->file->ext2, &dir->file->inode, &direntry, dir->offset, sizeof(struct ext2_dir_entry_2));
+		if (ret < 0)
+			return ret;
+		if (direntry.rec_len == 0)
+			return ERR_NOT_FOUND;
+
+		if (direntry.inode == 0)
+			dir->offset += direntry.rec_len;
+	} while (direntry.inode == 0);
 
 	memcpy(ent->name, direntry.name, direntry.name_len);
 	ent->name[direntry.name_len] = '\0';
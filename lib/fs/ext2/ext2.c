@@ -24,6 +24,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <debug.h>
+#include <err.h>
 #include <lib/fs.h>
 #include "ext2_priv.h"
 
@@ -68,8 +69,12 @@ static void endian_swap_superblock(struct ext2_super_block *sb)
     LE32SWAP(sb->s_journal_inum);
     LE32SWAP(sb->s_journal_dev);
     LE32SWAP(sb->s_last_orphan);
+    LE16SWAP(sb->s_desc_size);
     LE32SWAP(sb->s_default_mount_opts);
     LE32SWAP(sb->s_first_meta_bg);
+
+    /* ext4 */
+    LE32SWAP(sb->s_blocks_count_hi);
 }
 
 static void endian_swap_inode(struct ext2_inode *inode)
@@ -113,7 +118,9 @@ status_t ext2_mount(bdev_t *dev, fscookie **cookie)
 
     LTRACEF("dev %p\n", dev);
 
-    ext2_t *ext2 = malloc(sizeof(ext2_t));
+    ext2_t *ext2 = calloc(1, sizeof(ext2_t));
+    if (!ext2)
+        return ERR_NO_MEMORY;
     ext2->dev = dev;
 
     err = bio_read(dev, &ext2->sb, 1024, sizeof(struct ext2_super_block));
@@ -123,13 +130,15 @@ status_t ext2_mount(bdev_t *dev, fscookie **cookie)
     endian_swap_superblock(&ext2->sb);
 
     /* see if the superblock is good */
-    if (ext2->sb.s_magic != EXT2_SUPER_MAGIC) {
+    if (ext2->sb.s_magic != EXT2_SUPER_MAGIC || ext2->sb.s_blocks_per_group == 0 ||
+        ext2->sb.s_inodes_per_group == 0) {
         err = -1;
-        return err;
+        goto err;
     }
 
     /* calculate group count, rounded up */
     ext2->s_group_count = (ext2->sb.s_blocks_count + ext2->sb.s_blocks_per_group - 1) / ext2->sb.s_blocks_per_group;
+    ext2->s_desc_size = EXT2_DESC_SIZE(ext2->sb);
 
     /* print some info */
     LTRACEF("rev level %d\n", ext2->sb.s_rev_level);
@@ -142,49 +151,46 @@ status_t ext2_mount(bdev_t *dev, fscookie **cookie)
     LTRACEF("blocks per group %d\n", ext2->sb.s_blocks_per_group);
     LTRACEF("group count %d\n", ext2->s_group_count);
     LTRACEF("inodes per group %d\n", ext2->sb.s_inodes_per_group);
+    LTRACEF("group descriptor size %d\n", ext2->s_desc_size);
+    LTRACEF("groups per flex %d\n", 1 << ext2->sb.s_log_groups_per_flex);
 
     /* we only support dynamic revs */
     if (ext2->sb.s_rev_level > EXT2_DYNAMIC_REV) {
         err = -2;
-        return err;
+        goto err;
     }
 
-    /* make sure it doesn't have any ro features we don't support */
-    if (ext2->sb.s_feature_ro_compat & ~(EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER|EXT2_FEATURE_RO_COMPAT_LARGE_FILE)) {
+    /*
+     * Access is read-only, so ro compat features (e.g. metadata_csum,
+     * huge_file) do not matter. Only refuse incompat features that change
+     * how data is found on disk and that are not handled here.
+     */
+    if (ext2->sb.s_feature_incompat & ~EXT2_FEATURE_INCOMPAT_SUPP) {
+        dprintf(INFO, "ext2: unsupported incompat features 0x%x\n",
+                ext2->sb.s_feature_incompat & ~EXT2_FEATURE_INCOMPAT_SUPP);
         err = -3;
-        return err;
+        goto err;
     }
 
-    /* read in all the group descriptors */
-    ext2->gd = malloc(sizeof(struct ext2_group_desc) * ext2->s_group_count);
-    err = bio_read(ext2->dev, (void *)ext2->gd,
-                   (EXT2_BLOCK_SIZE(ext2->sb) == 4096) ? 4096 : 2048,
-                   sizeof(struct ext2_group_desc) * ext2->s_group_count);
-    if (err < 0) {
-        err = -4;
-        return err;
+    /* block numbers are 32-bit here */
+    if (ext2->sb.s_blocks_count_hi &&
+        (ext2->sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT)) {
+        err = -3;
+        goto err;
     }
 
-    int i;
-    for (i=0; i < ext2->s_group_count; i++) {
-        endian_swap_group_desc(&ext2->gd[i]);
-        LTRACEF("group %d:\n", i);
-        LTRACEF("\tblock bitmap %d\n", ext2->gd[i].bg_block_bitmap);
-        LTRACEF("\tinode bitmap %d\n", ext2->gd[i].bg_inode_bitmap);
-        LTRACEF("\tinode table %d\n", ext2->gd[i].bg_inode_table);
-        LTRACEF("\tfree blocks %d\n", ext2->gd[i].bg_free_blocks_count);
-        LTRACEF("\tfree inodes %d\n", ext2->gd[i].bg_free_inodes_count);
-        LTRACEF("\tused dirs %d\n", ext2->gd[i].bg_used_dirs_count);
+    if (ext2->s_desc_size < EXT2_MIN_DESC_SIZE || ext2->s_desc_size > EXT4_MAX_DESC_SIZE ||
+        (ext2->s_desc_size & (ext2->s_desc_size - 1))) {
+        err = -4;
+        goto err;
     }
 
-    /* initialize the block cache */
+    /*
+     * Group descriptors and the root inode are loaded on demand through the
+     * block cache, so probing a file system costs just the superblock read.
+     */
     ext2->cache = bcache_create(ext2->dev, EXT2_BLOCK_SIZE(ext2->sb), 4);
 
-    /* load the first inode */
-    err = ext2_load_inode(ext2, EXT2_ROOT_INO, &ext2->root_inode);
-    if (err < 0)
-        goto err;
-
 //  TRACE("successfully mounted volume\n");
 
     *cookie = (fscookie *)ext2;
@@ -204,25 +210,105 @@ status_t ext2_unmount(fscookie *cookie)
     ext2_t *ext2 = (ext2_t *)cookie;
 
     bcache_destroy(ext2->cache);
-    free(ext2->gd);
     free(ext2);
 
     return 0;
 }
 
-static void get_inode_addr(ext2_t *ext2, inodenum_t num, blocknum_t *block, size_t *block_offset)
+static bool ext2_is_power_of(uint32_t num, uint32_t base)
+{
+    while (num > 1 && num % base == 0)
+        num /= base;
+    return num == 1;
+}
+
+/* does the group carry a backup of the superblock (and descriptors)? */
+static bool ext2_group_has_super(ext2_t *ext2, groupnum_t group)
+{
+    if (!(ext2->sb.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER))
+        return true;
+
+    return group <= 1 || ext2_is_power_of(group, 3) ||
+           ext2_is_power_of(group, 5) || ext2_is_power_of(group, 7);
+}
+
+/* find the block holding the descriptor of a group */
+static blocknum_t ext2_group_desc_block(ext2_t *ext2, groupnum_t group)
+{
+    uint32_t desc_per_block = EXT2_BLOCK_SIZE(ext2->sb) / ext2->s_desc_size;
+    uint32_t desc_block = group / desc_per_block;
+    groupnum_t meta_group;
+
+    /* the descriptor blocks directly follow the superblock */
+    if (!(ext2->sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_META_BG) ||
+        desc_block < ext2->sb.s_first_meta_bg)
+        return ext2->sb.s_first_data_block + 1 + desc_block;
+
+    /* with meta_bg, each group of descriptors is stored in its first group */
+    meta_group = desc_block * desc_per_block;
+    return ext2->sb.s_first_data_block +
+           meta_group * ext2->sb.s_blocks_per_group +
+           (ext2_group_has_super(ext2, meta_group) ? 1 : 0);
+}
+
+static int ext2_load_group_desc(ext2_t *ext2, groupnum_t group, struct ext2_group_desc *gd)
+{
+    uint32_t desc_per_block = EXT2_BLOCK_SIZE(ext2->sb) / ext2->s_desc_size;
+    blocknum_t bnum;
+    void *cache_ptr;
+    uint8_t *desc;
+    int err;
+
+    if (group >= (groupnum_t)ext2->s_group_count)
+        return ERR_NOT_FOUND;
+
+    bnum = ext2_group_desc_block(ext2, group);
+
+    err = bcache_get_block(ext2->cache, &cache_ptr, bnum);
+    if (err < 0)
+        return err;
+
+    desc = (uint8_t *)cache_ptr + (group % desc_per_block) * ext2->s_desc_size;
+    memcpy(gd, desc, sizeof(struct ext2_group_desc));
+
+    /* inode tables beyond 32-bit block numbers cannot be reached */
+    if (ext2->s_desc_size >= EXT4_MIN_DESC_SIZE_64BIT &&
+        ((struct ext4_group_desc *)desc)->bg_inode_table_hi)
+        err = ERR_NOT_SUPPORTED;
+
+    bcache_put_block(ext2->cache, bnum);
+
+    endian_swap_group_desc(gd);
+
+    LTRACEF("group %d: block %u\n", group, bnum);
+    LTRACEF("\tblock bitmap %d\n", gd->bg_block_bitmap);
+    LTRACEF("\tinode bitmap %d\n", gd->bg_inode_bitmap);
+    LTRACEF("\tinode table %d\n", gd->bg_inode_table);
+
+    return err;
+}
+
+static int get_inode_addr(ext2_t *ext2, inodenum_t num, blocknum_t *block, size_t *block_offset)
 {
+    struct ext2_group_desc gd;
+    int err;
+
     num--;
 
     uint32_t group = num / ext2->sb.s_inodes_per_group;
 
     // calculate the start of the inode table for the group it's in
-    *block = ext2->gd[group].bg_inode_table;
+    err = ext2_load_group_desc(ext2, group, &gd);
+    if (err < 0)
+        return err;
+    *block = gd.bg_inode_table;
 
     // add the offset of the inode within the group
     size_t offset = (num % EXT2_INODES_PER_GROUP(ext2->sb)) * EXT2_INODE_SIZE(ext2->sb);
     *block_offset = offset % EXT2_BLOCK_SIZE(ext2->sb);
     *block += offset / EXT2_BLOCK_SIZE(ext2->sb);
+
+    return 0;
 }
 
 int ext2_load_inode(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode)
@@ -233,7 +319,9 @@ int ext2_load_inode(ext2_t *ext2, inodenum_t num, struct ext2_inode *inode)
 
     blocknum_t bnum;
     size_t block_offset;
-    get_inode_addr(ext2, num, &bnum, &block_offset);
+    err = get_inode_addr(ext2, num, &bnum, &block_offset);
+    if (err < 0)
+        return err;
 
     LTRACEF("bnum %u, offset %zd\n", bnum, block_offset);
 
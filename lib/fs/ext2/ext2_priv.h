@@ -39,8 +39,8 @@ typedef struct {
 
     struct ext2_super_block sb;
     int s_group_count;
-    struct ext2_group_desc *gd;
-    struct ext2_inode root_inode;
+    uint32_t s_desc_size;
+    struct ext2_inode root_inode; // loaded on first lookup
 } ext2_t;
 
 struct cache_block {
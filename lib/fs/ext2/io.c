@@ -141,6 +141,85 @@ error:
     return err;
 }
 
+/* look up a file block in an extent tree leaf, 0 if it is not mapped */
+static blocknum_t ext4_extent_leaf_lookup(const struct ext4_extent_header *eh, uint fileblock)
+{
+    const struct ext4_extent *ex = (const struct ext4_extent *)(eh + 1);
+    uint entries = LE16(eh->eh_entries);
+    uint i, start, len;
+
+    for (i = 0; i < entries; i++) {
+        start = LE32(ex[i].ee_block);
+        len = LE16(ex[i].ee_len);
+
+        if (fileblock < start)
+            break;
+
+        /* uninitialized (preallocated) extents read as zeroes */
+        if (len > EXT4_EXT_INIT_MAX_LEN) {
+            if (fileblock - start < len - EXT4_EXT_INIT_MAX_LEN)
+                return 0;
+            continue;
+        }
+
+        if (fileblock - start < len) {
+            if (LE16(ex[i].ee_start_hi))
+                return 0;
+            return LE32(ex[i].ee_start_lo) + (fileblock - start);
+        }
+    }
+
+    return 0;
+}
+
+/* translate a file block to a physical block by walking the extent tree */
+static blocknum_t ext4_extent_block_to_fs_block(ext2_t *ext2, struct ext2_inode *inode, uint fileblock)
+{
+    const struct ext4_extent_header *eh = (const struct ext4_extent_header *)inode->i_block;
+    const struct ext4_extent_idx *ix;
+    blocknum_t block = 0, cache_block = 0;
+    void *cache_ptr;
+    uint depth, entries, i;
+
+    for (depth = 0; depth <= EXT4_EXT_MAX_DEPTH; depth++) {
+        if (LE16(eh->eh_magic) != EXT4_EXT_MAGIC)
+            break;
+
+        if (LE16(eh->eh_depth) == 0) {
+            block = ext4_extent_leaf_lookup(eh, fileblock);
+            break;
+        }
+
+        /* find the last index entry starting at or before the block */
+        ix = (const struct ext4_extent_idx *)(eh + 1);
+        entries = LE16(eh->eh_entries);
+        if (entries == 0 || LE32(ix[0].ei_block) > fileblock)
+            break;
+        for (i = 1; i < entries && LE32(ix[i].ei_block) <= fileblock; i++)
+            ;
+        if (LE16(ix[i - 1].ei_leaf_hi))
+            break;
+
+        blocknum_t next = LE32(ix[i - 1].ei_leaf_lo);
+
+        if (cache_block)
+            ext2_put_block(ext2, cache_block);
+        cache_block = 0;
+
+        if (ext2_get_block(ext2, &cache_ptr, next) < 0)
+            break;
+        cache_block = next;
+        eh = cache_ptr;
+    }
+
+    if (cache_block)
+        ext2_put_block(ext2, cache_block);
+
+    LTRACEF("extent: fileblock %u -> %u\n", fileblock, block);
+
+    return block;
+}
+
 /* translate a file block to a physical block */
 static blocknum_t file_block_to_fs_block(ext2_t *ext2, struct ext2_inode *inode, uint fileblock)
 {
@@ -149,6 +228,9 @@ static blocknum_t file_block_to_fs_block(ext2_t *ext2, struct ext2_inode *inode,
 
     LTRACEF("inode %p, fileblock %u\n", inode, fileblock);
 
+    if (inode->i_flags & EXT4_EXTENTS_FL)
+        return ext4_extent_block_to_fs_block(ext2, inode, fileblock);
+
     uint32_t pos[4];
     uint32_t level = 0;
     ext2_calculate_block_pointer_pos(ext2, fileblock, &level, pos);
@@ -231,20 +313,40 @@ ssize_t ext2_read_inode(ext2_t *ext2, struct ext2_inode *inode, void *_buf, off_
         blocknum_t phys_block = file_block_to_fs_block(ext2, inode, file_block);
         blocknum_t count_cont_blks = 1;
         blocknum_t max_blocks = len / EXT2_BLOCK_SIZE(ext2->sb);
+        size_t tail = 0;
         if (phys_block == 0) {
             memset(buf, 0, EXT2_BLOCK_SIZE(ext2->sb));
         } else {
             while (count_cont_blks < max_blocks && file_block_to_fs_block(ext2, inode, file_block + count_cont_blks) == phys_block + count_cont_blks) {
                 count_cont_blks++;
             }
-            bio_read(ext2->dev, buf, EXT2_BLOCK_SIZE(ext2->sb) * phys_block, EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks);
+
+            /* read the partial last block together with the run if it follows directly */
+            if (count_cont_blks == max_blocks && (len % EXT2_BLOCK_SIZE(ext2->sb)) != 0 &&
+                file_block_to_fs_block(ext2, inode, file_block + count_cont_blks) == phys_block + count_cont_blks) {
+                tail = len % EXT2_BLOCK_SIZE(ext2->sb);
+            }
+
+            if (tail) {
+                /* read the whole last block into a bounce buffer in the same request */
+                STACKBUF_DMA_ALIGN(temp, EXT2_BLOCK_SIZE(ext2->sb));
+                bio_vec_t vec[2] = {
+                    { buf, EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks },
+                    { temp, EXT2_BLOCK_SIZE(ext2->sb) },
+                };
+
+                bio_readv(ext2->dev, vec, 2, EXT2_BLOCK_SIZE(ext2->sb) * phys_block);
+                memcpy(buf + EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks, temp, tail);
+            } else {
+                bio_read(ext2->dev, buf, EXT2_BLOCK_SIZE(ext2->sb) * phys_block, EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks);
+            }
         }
 
         /* increment our stuff */
         file_block += count_cont_blks;
-        len -= EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks;
-        bytes_read += EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks;
-        buf += EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks;
+        len -= EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks + tail;
+        bytes_read += EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks + tail;
+        buf += EXT2_BLOCK_SIZE(ext2->sb) * count_cont_blks + tail;
     }
 
     /* handle partial last block */
@@ -158,6 +158,12 @@ int partition_publish(const char *device, off_t offset)
 					dprintf(INFO, "error publishing subdevice '%s'\n", subdevice);
 					continue;
 				}
+
+				bdev_t *partdev = bio_open(subdevice);
+				if (partdev) {
+					partdev->part_mbr_type = part[i].type;
+					bio_close(partdev);
+				}
 				count++;
 			}
 		}
@@ -248,6 +254,7 @@ int partition_publish(const char *device, off_t offset)
 				bdev_t *partdev = bio_open(subdevice);
 				partdev->label = strdup((char*)name);
 				partdev->is_gpt = true;
+				memcpy(partdev->part_type_guid, type_guid, sizeof(partdev->part_type_guid));
 
 				/* Some linux distros make use of subpartitions.
 				 * Scan some devices recursively to publish them. */
@@ -284,6 +291,9 @@ int partition_unpublish(const char *device)
 		if (!dev)
 			continue;
 
+		/* remove subpartitions published on top of this one first */
+		count += partition_unpublish(devname);
+
 		bio_unregister_device(dev);
 		bio_close(dev);
 		count++;
@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <debug.h>
+#include <lk2nd.h>
+#include <platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <target.h>
+
+#include <crc32.h>
+#include <crypto_hash.h>
+
+/*
+ * Content-addressed cache for "fastboot oem cache-boot": boot image sections
+ * (kernel, ramdisk, ...) are stored by their SHA-256 digest at the end of the
+ * scratch region, so the host only needs to send the sections that changed.
+ *
+ * The cache stays reserved (also for the kernel) after booting from it, so it
+ * survives the reboot back into lk2nd. Since the memory is not preserved in
+ * all cases, each entry is verified again before it is used the first time.
+ */
+#define BOOT_CACHE_MAGIC	0x43424b4c	/* "LKBC" */
+#define BOOT_CACHE_MAX_ENTRIES	16
+#define BOOT_CACHE_ALIGN	4096
+
+struct boot_cache_entry {
+	uint8_t digest[LK2ND_BOOT_CACHE_DIGEST_SIZE];
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct boot_cache_header {
+	uint32_t magic;
+	uint32_t size;
+	uint32_t count;
+	uint32_t used;
+	struct boot_cache_entry entries[BOOT_CACHE_MAX_ENTRIES];
+	uint32_t crc;
+};
+
+#define BOOT_CACHE_DATA_START	ROUNDUP(sizeof(struct boot_cache_header), BOOT_CACHE_ALIGN)
+
+static struct boot_cache_header *cache;
+static bool verified[BOOT_CACHE_MAX_ENTRIES];
+static bool keep;
+
+static uint32_t boot_cache_crc(void)
+{
+	return crc32(0, (const unsigned char *)cache,
+		     sizeof(*cache) - sizeof(cache->crc));
+}
+
+static void boot_cache_commit(void)
+{
+	cache->crc = boot_cache_crc();
+}
+
+void lk2nd_boot_cache_clear(void)
+{
+	if (!cache)
+		return;
+
+	cache->count = 0;
+	cache->used = 0;
+	memset(cache->entries, 0, sizeof(cache->entries));
+	memset(verified, 0, sizeof(verified));
+	boot_cache_commit();
+}
+
+void lk2nd_boot_cache_init(void)
+{
+	uint32_t size = LK2ND_BOOT_CACHE_SIZE * 1024 * 1024;
+	uint32_t max = target_get_max_flash_size();
+	addr_t base;
+
+	/* Leave at least as much for downloads as the cache takes */
+	if (max < 2 * size) {
+		dprintf(CRITICAL, "boot-cache: Not enough memory for %u MiB cache\n",
+			LK2ND_BOOT_CACHE_SIZE);
+		return;
+	}
+
+	base = (addr_t)target_get_scratch_address() + max - size;
+	lk2nd_mem_reserve("boot-cache", base, size, NULL);
+	cache = (struct boot_cache_header *)base;
+
+	if (cache->magic == BOOT_CACHE_MAGIC && cache->size == size &&
+	    cache->crc == boot_cache_crc() &&
+	    cache->count <= BOOT_CACHE_MAX_ENTRIES &&
+	    cache->used <= size - BOOT_CACHE_DATA_START) {
+		dprintf(INFO, "boot-cache: %u entries (%u KiB) kept @ %#lx\n",
+			cache->count, cache->used / 1024, base);
+		return;
+	}
+
+	cache->magic = BOOT_CACHE_MAGIC;
+	cache->size = size;
+	lk2nd_boot_cache_clear();
+	dprintf(INFO, "boot-cache: %u MiB @ %#lx\n", LK2ND_BOOT_CACHE_SIZE, base);
+}
+
+void lk2nd_boot_cache_digest(const void *data, size_t size, uint8_t *digest)
+{
+	target_crypto_init_params();
+	hash_find((unsigned char *)data, size, digest, CRYPTO_AUTH_ALG_SHA256);
+}
+
+static int boot_cache_find(const uint8_t *digest)
+{
+	uint32_t i;
+
+	for (i = 0; i < cache->count; i++)
+		if (!memcmp(cache->entries[i].digest, digest,
+			    LK2ND_BOOT_CACHE_DIGEST_SIZE))
+			return i;
+
+	return -1;
+}
+
+int lk2nd_boot_cache_put(const void *data, size_t size, uint8_t *digest)
+{
+	struct boot_cache_entry *e;
+
+	if (!cache)
+		return -1;
+
+	lk2nd_boot_cache_digest(data, size, digest);
+	if (boot_cache_find(digest) >= 0)
+		return 0;
+
+	if (size > cache->size - BOOT_CACHE_DATA_START)
+		return -1;
+
+	/* Start over when full, old entries are likely stale anyway */
+	if (cache->count == BOOT_CACHE_MAX_ENTRIES ||
+	    size > cache->size - BOOT_CACHE_DATA_START - cache->used) {
+		dprintf(INFO, "boot-cache: Full, dropping all entries\n");
+		lk2nd_boot_cache_clear();
+	}
+
+	e = &cache->entries[cache->count];
+	memcpy(e->digest, digest, LK2ND_BOOT_CACHE_DIGEST_SIZE);
+	e->offset = BOOT_CACHE_DATA_START + cache->used;
+	e->size = size;
+	memcpy((uint8_t *)cache + e->offset, data, size);
+
+	verified[cache->count] = true;
+	cache->used += ROUNDUP(size, BOOT_CACHE_ALIGN);
+	cache->count++;
+	boot_cache_commit();
+	return 0;
+}
+
+const void *lk2nd_boot_cache_get(const uint8_t *digest, size_t size)
+{
+	uint8_t actual[LK2ND_BOOT_CACHE_DIGEST_SIZE];
+	struct boot_cache_entry *e;
+	const void *data;
+	int i;
+
+	if (!cache)
+		return NULL;
+
+	i = boot_cache_find(digest);
+	if (i < 0 || cache->entries[i].size != size)
+		return NULL;
+
+	e = &cache->entries[i];
+	data = (uint8_t *)cache + e->offset;
+	if (verified[i])
+		return data;
+
+	lk2nd_boot_cache_digest(data, e->size, actual);
+	if (memcmp(actual, e->digest, sizeof(actual))) {
+		dprintf(CRITICAL, "boot-cache: Entry %d was corrupted, dropping all\n", i);
+		lk2nd_boot_cache_clear();
+		return NULL;
+	}
+
+	verified[i] = true;
+	return data;
+}
+
+/* Keep the cache reserved for the kernel, so it survives a reboot */
+void lk2nd_boot_cache_keep(void)
+{
+	keep = true;
+}
+
+void lk2nd_boot_cache_update_device_tree(void *fdt)
+{
+	if (cache && !keep)
+		lk2nd_mem_release((addr_t)cache);
+}
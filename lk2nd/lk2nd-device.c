@@ -406,6 +406,32 @@ int lk2nd_fdt_parse_early_uart(void)
 	return -1;
 }
 
+/* Card detect GPIO for the SD card, needed before lk2nd_init() */
+int lk2nd_fdt_parse_sd_cd_gpio(uint8_t *pull, uint8_t *active)
+{
+	int offset, len;
+	const uint32_t *val;
+	uint32_t flags;
+	void *fdt = lk2nd_get_fdt();
+
+	if (!fdt || dev_tree_check_header(fdt))
+		return -1;
+
+	offset = lk2nd_find_device_offset(fdt);
+	if (offset < 0)
+		return -1;
+
+	/* Same encoding as lk2nd,keys: <gpio (pull | active << 8)> */
+	val = fdt_getprop(fdt, offset, "lk2nd,sd-cd-gpio", &len);
+	if (len != 2 * sizeof(*val))
+		return -1;
+
+	flags = fdt32_to_cpu(val[1]);
+	*pull = flags & 0xFF;
+	*active = flags >> 8;
+	return fdt32_to_cpu(val[0]);
+}
+
 static void lk2nd_fdt_parse(void)
 {
 	void *fdt = lk2nd_get_fdt();
@@ -441,6 +467,10 @@ void lk2nd_init(void)
 	dump_board();
 	lk2nd_fdt_parse();
 	lk2nd_target_keystatus();
+
+#ifdef SMP_SPIN_TABLE_BASE
+	smp_spin_table_park((struct smp_spin_table*)SMP_SPIN_TABLE_BASE, lk2nd_dev.fdt);
+#endif
 }
 
 static void lk2nd_update_panel_compatible(void *fdt)
@@ -537,9 +567,17 @@ void lk2nd_update_device_tree(void *fdt, const char *cmdline, bool arm64)
 	smb1360_update_device_tree(fdt);
 #endif
 	lk2nd_rproc_update_dev_tree(fdt);
+#if LK2ND_CONT_SPLASH
+	lk2nd_cont_splash_update_device_tree(fdt);
+#endif
+#if LK2ND_BOOT_CACHE
+	lk2nd_boot_cache_update_device_tree(fdt);
+#endif
 
 #ifdef SMP_SPIN_TABLE_BASE
 	smp_spin_table_setup((struct smp_spin_table*)SMP_SPIN_TABLE_BASE, fdt, arm64,
 			     lk2nd_cmdline_scan(cmdline, "lk2nd.spin-table=force"));
 #endif
+
+	lk2nd_mem_update_device_tree(fdt);
 }
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <boot_device.h>
+#include <boot_stats.h>
+#include <crc32.h>
+#include <debug.h>
+#include <lk2nd.h>
+#include <mmc_sdhci.h>
+#include <mmc_wrapper.h>
+#include <partition_parser.h>
+#include <platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <target.h>
+
+/*
+ * Boot history: one small record per boot, kept in a ring on storage
+ * (LK2ND_BOOT_HISTORY_PARTITION at LK2ND_BOOT_HISTORY_OFFSET), to spot
+ * boot time regressions or a degrading eMMC over time. Saving a record
+ * writes exactly one block, so the flash wear is negligible.
+ */
+#ifndef LK2ND_BOOT_HISTORY_OFFSET
+#define LK2ND_BOOT_HISTORY_OFFSET	0
+#endif
+
+#define BOOT_HISTORY_MAGIC	0x48424b4c	/* "LKBH" */
+#define BOOT_HISTORY_RECORDS	64
+#define BOOT_HISTORY_SIZE	(BOOT_HISTORY_RECORDS * sizeof(struct boot_record))
+
+/* Frequency of the sleep clock used by boot_stats */
+#define SCLK_HZ			32768
+
+struct boot_record {
+	uint32_t magic;
+	uint32_t seq;
+
+	/* Time since power on (ms) */
+	uint32_t lk_start;
+	uint32_t splash;
+	uint32_t load_start;
+	uint32_t load_done;
+	uint32_t handoff;
+
+	/* Storage performance (all reads in lk2nd) */
+	uint32_t read_kib;
+	uint32_t read_ms;
+	uint32_t mmc_clk_khz;
+	uint16_t mmc_timing;
+	uint16_t reserved;
+
+	char source[16];
+	uint32_t crc;
+};
+
+BUF_DMA_ALIGN(history_buf, BOOT_HISTORY_SIZE);
+
+static char boot_source[sizeof(((struct boot_record *)0)->source)];
+
+void lk2nd_boot_history_set_source(const char *source)
+{
+	strlcpy(boot_source, source, sizeof(boot_source));
+}
+
+static uint32_t sclk_to_ms(uint32_t count)
+{
+	return (uint64_t)count * 1000 / SCLK_HZ;
+}
+
+static uint32_t boot_record_crc(const struct boot_record *r)
+{
+	return crc32(0, (const unsigned char *)r, sizeof(*r) - sizeof(r->crc));
+}
+
+static bool boot_record_valid(const struct boot_record *r)
+{
+	return r->magic == BOOT_HISTORY_MAGIC && r->crc == boot_record_crc(r);
+}
+
+static unsigned long long boot_history_locate(void)
+{
+	unsigned long long offset, size;
+	int index;
+
+	index = partition_get_index(LK2ND_BOOT_HISTORY_PARTITION);
+	if (index == INVALID_PTN) {
+		dprintf(INFO, "boot-history: No %s partition\n",
+			LK2ND_BOOT_HISTORY_PARTITION);
+		return 0;
+	}
+
+	offset = partition_get_offset(index);
+	size = partition_get_size(index);
+	if (!offset || size < LK2ND_BOOT_HISTORY_OFFSET + BOOT_HISTORY_SIZE) {
+		dprintf(CRITICAL, "boot-history: %s partition is too small\n",
+			LK2ND_BOOT_HISTORY_PARTITION);
+		return 0;
+	}
+
+	return offset + LK2ND_BOOT_HISTORY_OFFSET;
+}
+
+/* Read the ring and return the slot of the newest record, or -1 if empty */
+static int boot_history_read(unsigned long long *offset)
+{
+	struct boot_record *records = (struct boot_record *)history_buf;
+	uint32_t seq = 0;
+	int i, newest = -1;
+
+	*offset = boot_history_locate();
+	if (!*offset)
+		return -1;
+
+	if (mmc_read(*offset, (uint32_t *)history_buf, BOOT_HISTORY_SIZE)) {
+		dprintf(CRITICAL, "boot-history: Failed to read history\n");
+		*offset = 0;
+		return -1;
+	}
+
+	for (i = 0; i < BOOT_HISTORY_RECORDS; i++) {
+		if (boot_record_valid(&records[i]) &&
+		    (newest < 0 || records[i].seq > seq)) {
+			newest = i;
+			seq = records[i].seq;
+		}
+	}
+
+	return newest;
+}
+
+void lk2nd_boot_history_save(void)
+{
+	struct boot_record *records = (struct boot_record *)history_buf;
+	struct boot_record *r;
+	struct mmc_device *dev;
+	unsigned long long offset;
+	uint32_t block_size = mmc_get_device_blocksize();
+	uint32_t block;
+	uint64_t read_bytes, read_us;
+	int newest, slot;
+
+	if (!block_size || BOOT_HISTORY_SIZE % block_size)
+		return;
+
+	newest = boot_history_read(&offset);
+	if (!offset)
+		return;
+
+	slot = (newest + 1) % BOOT_HISTORY_RECORDS;
+	r = &records[slot];
+	memset(r, 0, sizeof(*r));
+
+	r->magic = BOOT_HISTORY_MAGIC;
+	r->seq = newest < 0 ? 1 : records[newest].seq + 1;
+
+	r->lk_start = sclk_to_ms(bs_get_timestamp(BS_BL_START));
+	r->splash = sclk_to_ms(bs_get_timestamp(BS_SPLASH_SCREEN_DISPLAY));
+	r->load_start = sclk_to_ms(bs_get_timestamp(BS_KERNEL_LOAD_START));
+	r->load_done = sclk_to_ms(bs_get_timestamp(BS_KERNEL_LOAD_DONE));
+	r->handoff = sclk_to_ms(platform_get_sclk_count());
+
+	mmc_get_read_stats(&read_bytes, &read_us);
+	r->read_kib = read_bytes / 1024;
+	r->read_ms = read_us / 1000;
+
+	if (platform_boot_dev_isemmc()) {
+		dev = target_mmc_device();
+		r->mmc_clk_khz = dev->host.cur_clk_rate / 1000;
+		r->mmc_timing = dev->host.timing;
+	}
+
+	strlcpy(r->source, boot_source[0] ? boot_source : "unknown",
+		sizeof(r->source));
+	r->crc = boot_record_crc(r);
+
+	/* Only write the block that contains the new record */
+	block = ROUNDDOWN(slot * sizeof(*r), block_size);
+	if (mmc_write(offset + block, block_size, history_buf + block))
+		dprintf(CRITICAL, "boot-history: Failed to save record\n");
+	else
+		dprintf(INFO, "boot-history: Saved record %u\n", r->seq);
+}
+
+/* Format the history (oldest first) as text, returns the length */
+size_t lk2nd_boot_history_dump(char *buf, size_t size)
+{
+	struct boot_record *records = (struct boot_record *)history_buf;
+	struct boot_record *r;
+	unsigned long long offset;
+	size_t len = 0;
+	int newest, i;
+
+	newest = boot_history_read(&offset);
+	if (newest < 0)
+		return 0;
+
+	for (i = 1; i <= BOOT_HISTORY_RECORDS && len < size; i++) {
+		r = &records[(newest + i) % BOOT_HISTORY_RECORDS];
+		if (!boot_record_valid(r))
+			continue;
+
+		len += snprintf(buf + len, size - len,
+			"#%u %s: lk %u splash %u load %u-%u handoff %u ms, "
+			"read %u KiB in %u ms, mmc %u kHz timing %u\n",
+			r->seq, r->source, r->lk_start, r->splash,
+			r->load_start, r->load_done, r->handoff,
+			r->read_kib, r->read_ms, r->mmc_clk_khz, r->mmc_timing);
+	}
+
+	return MIN(len, size);
+}
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <debug.h>
+#include <libfdt.h>
+#include <lk2nd.h>
+#include <stdlib.h>
+
+/*
+ * Memory that lk2nd still needs after the handoff to the kernel
+ * (e.g. CPUs spinning in the spin-table, or the framebuffer that is still
+ * being scanned out). All other memory used by lk2nd (scratch, download
+ * and display back buffers, ...) is free for the kernel, so only these
+ * regions are reserved in the device tree, exactly as large as needed.
+ */
+#define LK2ND_MEM_MAX_REGIONS	8
+
+struct lk2nd_mem_region {
+	const char *name;
+	uint64_t base;
+	uint64_t size;
+	const char *user;
+};
+
+static struct lk2nd_mem_region regions[LK2ND_MEM_MAX_REGIONS];
+
+/*
+ * If user is set, the region is only reserved if the device tree has
+ * an enabled node with that compatible (i.e. the kernel will use it).
+ */
+void lk2nd_mem_reserve(const char *name, uint64_t base, uint64_t size,
+		       const char *user)
+{
+	int i, free = -1;
+
+	for (i = 0; i < LK2ND_MEM_MAX_REGIONS; i++) {
+		if (regions[i].size && regions[i].base == base)
+			break;
+		if (!regions[i].size && free < 0)
+			free = i;
+	}
+
+	if (i == LK2ND_MEM_MAX_REGIONS) {
+		if (free < 0) {
+			dprintf(CRITICAL, "lk2nd-mem: Too many reserved regions, "
+				"cannot reserve %s\n", name);
+			return;
+		}
+		i = free;
+	}
+
+	regions[i].name = name;
+	regions[i].base = base;
+	regions[i].size = size;
+	regions[i].user = user;
+}
+
+void lk2nd_mem_release(uint64_t base)
+{
+	int i;
+
+	for (i = 0; i < LK2ND_MEM_MAX_REGIONS; i++)
+		if (regions[i].size && regions[i].base == base)
+			regions[i].size = 0;
+}
+
+static uint64_t lk2nd_mem_read_cells(const fdt32_t *cells, int count)
+{
+	uint64_t val = 0;
+
+	while (count--)
+		val = (val << 32) | fdt32_to_cpu(*cells++);
+	return val;
+}
+
+/*
+ * Call fn for each region reserved by the device tree (/memreserve/ and
+ * /reserved-memory nodes with a reg), until it returns true.
+ */
+static bool lk2nd_mem_for_each_reserved(const void *fdt,
+					bool (*fn)(uint64_t base, uint64_t size, void *data),
+					void *data)
+{
+	int rmem, node, addr_cells, size_cells, len, n;
+	uint64_t rbase, rsize;
+	const fdt32_t *reg;
+
+	for (n = 0; n < fdt_num_mem_rsv(fdt); n++) {
+		if (fdt_get_mem_rsv(fdt, n, &rbase, &rsize) == 0 && rsize &&
+		    fn(rbase, rsize, data))
+			return true;
+	}
+
+	rmem = fdt_path_offset(fdt, "/reserved-memory");
+	if (rmem < 0)
+		return false;
+
+	addr_cells = fdt_address_cells(fdt, rmem);
+	size_cells = fdt_size_cells(fdt, rmem);
+	if (addr_cells < 1 || addr_cells > 2 || size_cells < 1 || size_cells > 2)
+		return false;
+
+	fdt_for_each_subnode(node, fdt, rmem) {
+		if (!lkfdt_node_is_available(fdt, node))
+			continue;
+
+		reg = fdt_getprop(fdt, node, "reg", &len);
+		if (!reg || len < (int)((addr_cells + size_cells) * sizeof(*reg)))
+			continue;
+
+		rbase = lk2nd_mem_read_cells(reg, addr_cells);
+		rsize = lk2nd_mem_read_cells(reg + addr_cells, size_cells);
+		if (fn(rbase, rsize, data))
+			return true;
+	}
+
+	return false;
+}
+
+struct lk2nd_mem_range {
+	uint64_t start;
+	uint64_t end;
+};
+
+static bool lk2nd_mem_clip(uint64_t base, uint64_t size, void *data)
+{
+	struct lk2nd_mem_range *range = data;
+
+	if (base + size > range->start && base < range->end)
+		range->end = MAX(base, range->start);
+	return false;
+}
+
+/*
+ * Returns the start of the first region in [start, end) that is still
+ * needed by lk2nd or reserved by the device tree lk2nd was booted with
+ * (or end), e.g. to limit the download buffer.
+ */
+uint64_t lk2nd_mem_limit(uint64_t start, uint64_t end)
+{
+	struct lk2nd_mem_range range = { start, end };
+	struct lk2nd_mem_region *r;
+
+	for (r = regions; r < regions + LK2ND_MEM_MAX_REGIONS; r++)
+		if (r->size)
+			lk2nd_mem_clip(r->base, r->size, &range);
+
+	if (lk2nd_dev.fdt)
+		lk2nd_mem_for_each_reserved(lk2nd_dev.fdt, lk2nd_mem_clip, &range);
+
+	return range.end;
+}
+
+static bool lk2nd_mem_covered(uint64_t base, uint64_t size, void *data)
+{
+	struct lk2nd_mem_range *range = data;
+
+	return range->start >= base && range->end <= base + size;
+}
+
+/* Check if the region is already reserved by the device tree itself */
+static bool lk2nd_mem_is_reserved(const void *fdt, uint64_t base, uint64_t size)
+{
+	struct lk2nd_mem_range range = { base, base + size };
+
+	return lk2nd_mem_for_each_reserved(fdt, lk2nd_mem_covered, &range);
+}
+
+static bool lk2nd_mem_has_user(const void *fdt, const char *compatible)
+{
+	int node;
+
+	node = fdt_node_offset_by_compatible(fdt, -1, compatible);
+	for (; node >= 0; node = fdt_node_offset_by_compatible(fdt, node, compatible))
+		if (lkfdt_node_is_available(fdt, node))
+			return true;
+
+	return false;
+}
+
+void lk2nd_mem_update_device_tree(void *fdt)
+{
+	struct lk2nd_mem_region *r;
+	int ret;
+
+	for (r = regions; r < regions + LK2ND_MEM_MAX_REGIONS; r++) {
+		if (!r->size)
+			continue;
+
+		if (r->user && !lk2nd_mem_has_user(fdt, r->user)) {
+			dprintf(INFO, "lk2nd-mem: %s (%#llx-%#llx) unused, not reserved\n",
+				r->name, r->base, r->base + r->size - 1);
+			continue;
+		}
+
+		if (lk2nd_mem_is_reserved(fdt, r->base, r->size)) {
+			dprintf(INFO, "lk2nd-mem: %s (%#llx-%#llx) already reserved\n",
+				r->name, r->base, r->base + r->size - 1);
+			continue;
+		}
+
+		dprintf(INFO, "lk2nd-mem: Reserving %s (%#llx-%#llx)\n",
+			r->name, r->base, r->base + r->size - 1);
+
+		ret = fdt_add_mem_rsv(fdt, r->base, r->size);
+		if (ret)
+			dprintf(CRITICAL, "lk2nd-mem: Failed to reserve %s: %d\n",
+				r->name, ret);
+	}
+}
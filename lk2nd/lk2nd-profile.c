@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <arch/arm.h>
+#include <debug.h>
+#include <kernel/thread.h>
+#include <kernel/timer.h>
+#include <lk2nd.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Statistical profiler: a periodic timer samples the PC (and LR) of the
+ * context interrupted by the timer interrupt into a ring buffer.
+ * The samples are uploaded with "fastboot oem profile-dump" and resolved on
+ * the host using the symbol table of the build (lk.elf.sym). LR is only the
+ * caller for leaf functions, but it is usually good enough for a flat profile.
+ *
+ * Code running with interrupts disabled is not sampled, the sample is taken
+ * as soon as interrupts are enabled again.
+ */
+#ifndef LK2ND_PROFILE_SAMPLES
+#define LK2ND_PROFILE_SAMPLES	8192
+#endif
+
+#define LK2ND_PROFILE_MAGIC	"LK2NDPRF"
+#define LK2ND_PROFILE_VERSION	1
+
+struct lk2nd_profile_sample {
+	uint32_t pc;
+	uint32_t lr;
+};
+
+struct lk2nd_profile_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t rate_hz;
+	uint32_t count;		/* samples following the header */
+	uint32_t total;		/* samples taken, including overwritten ones */
+	uint32_t base;		/* load address of lk2nd (_start) */
+	uint32_t sample_size;
+};
+
+extern struct arm_iframe *platform_irq_frame;
+extern char _start;
+
+static struct lk2nd_profile_sample samples[LK2ND_PROFILE_SAMPLES];
+static unsigned int next, total, rate_hz;
+static bool running;
+static timer_t profile_timer;
+
+static enum handler_return lk2nd_profile_sample(struct timer *timer,
+						time_t now, void *arg)
+{
+	struct arm_iframe *frame = platform_irq_frame;
+
+	if (!frame)
+		return INT_NO_RESCHEDULE;
+
+	samples[next].pc = frame->pc;
+	samples[next].lr = frame->lr;
+	next = (next + 1) % LK2ND_PROFILE_SAMPLES;
+	total++;
+
+	return INT_NO_RESCHEDULE;
+}
+
+void lk2nd_profile_start(unsigned int hz)
+{
+	time_t period;
+
+	if (!hz)
+		hz = 1000;
+
+	period = 1000 / hz;
+	if (!period)
+		period = 1;
+
+	lk2nd_profile_stop();
+
+	enter_critical_section();
+	next = 0;
+	total = 0;
+	rate_hz = 1000 / period;
+	running = true;
+	timer_initialize(&profile_timer);
+	timer_set_periodic(&profile_timer, period, lk2nd_profile_sample, NULL);
+	exit_critical_section();
+
+	dprintf(INFO, "lk2nd-profile: Sampling at %u Hz\n", rate_hz);
+}
+
+void lk2nd_profile_stop(void)
+{
+	if (!running)
+		return;
+
+	timer_cancel(&profile_timer);
+	running = false;
+
+	dprintf(INFO, "lk2nd-profile: Stopped after %u samples\n", total);
+}
+
+/*
+ * Write the header and the samples (oldest first) to buf.
+ * Returns the number of bytes written, or 0 if buf is too small.
+ */
+size_t lk2nd_profile_dump(void *buf, size_t size)
+{
+	struct lk2nd_profile_header *hdr = buf;
+	struct lk2nd_profile_sample *out = (void *)(hdr + 1);
+	unsigned int count, first;
+	size_t len;
+
+	enter_critical_section();
+
+	count = MIN(total, LK2ND_PROFILE_SAMPLES);
+	len = sizeof(*hdr) + count * sizeof(*out);
+	if (len > size) {
+		exit_critical_section();
+		return 0;
+	}
+
+	memcpy(hdr->magic, LK2ND_PROFILE_MAGIC, sizeof(hdr->magic));
+	hdr->version = LK2ND_PROFILE_VERSION;
+	hdr->rate_hz = rate_hz;
+	hdr->count = count;
+	hdr->total = total;
+	hdr->base = (uint32_t)&_start;
+	hdr->sample_size = sizeof(*out);
+
+	first = (next + LK2ND_PROFILE_SAMPLES - count) % LK2ND_PROFILE_SAMPLES;
+	if (first + count <= LK2ND_PROFILE_SAMPLES) {
+		memcpy(out, &samples[first], count * sizeof(*out));
+	} else {
+		unsigned int part = LK2ND_PROFILE_SAMPLES - first;
+
+		memcpy(out, &samples[first], part * sizeof(*out));
+		memcpy(out + part, samples, (count - part) * sizeof(*out));
+	}
+
+	exit_critical_section();
+	return len;
+}
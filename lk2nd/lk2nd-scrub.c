@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <debug.h>
+#include <dma.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <kernel/thread.h>
+#include <lk2nd.h>
+#include <mmc_sdhci.h>
+#include <mmc_wrapper.h>
+#include <partition_parser.h>
+#include <platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <target.h>
+
+/*
+ * Background scrub: read the partitions in LK2ND_SCRUB_PARTITIONS (e.g. boot,
+ * which also holds lk2nd and its DTBs) at low priority while lk2nd waits in
+ * fastboot, to notice a degrading eMMC (read retries, slow or failing blocks)
+ * before it breaks booting. The read latency is tracked per region, the
+ * regions that failed or were much slower than the rest are reported with
+ * "fastboot oem scrub".
+ *
+ * Fastboot commands pause the scrub, so it never competes with foreground
+ * transfers. A command only waits for the chunk that is already in flight.
+ */
+#define SCRUB_CHUNK_SIZE	(64 * 1024)
+#define SCRUB_REGION_SIZE	(1024 * 1024)
+#define SCRUB_MAX_REGIONS	256
+#define SCRUB_INTERVAL_MS	10
+
+/* Regions with a chunk this much slower than the fastest one are reported */
+#define SCRUB_SLOW_FACTOR	4
+
+struct scrub_region {
+	const char *name;
+	uint64_t offset;	/* on the card */
+	uint32_t ptn_offset;
+	uint32_t size;
+	uint32_t done;
+	uint32_t chunks;
+	uint32_t max_us;
+	uint32_t total_us;
+	uint32_t errors;
+};
+
+BUF_DMA_ALIGN(scrub_buf, SCRUB_CHUNK_SIZE);
+
+static char scrub_names[] = LK2ND_SCRUB_PARTITIONS;
+static struct scrub_region regions[SCRUB_MAX_REGIONS];
+static unsigned int region_count;
+static uint32_t best_us;
+
+static mutex_t scrub_lock;
+static event_t scrub_resume;
+static volatile int paused;
+static bool initialized, running;
+
+static void scrub_add_partition(const char *name)
+{
+	unsigned long long offset, size, pos;
+	struct scrub_region *r;
+	int index;
+
+	index = partition_get_index(name);
+	if (index == INVALID_PTN) {
+		dprintf(INFO, "scrub: No %s partition\n", name);
+		return;
+	}
+
+	offset = partition_get_offset(index);
+	size = partition_get_size(index);
+
+	for (pos = 0; pos < size; pos += SCRUB_REGION_SIZE) {
+		if (region_count == SCRUB_MAX_REGIONS) {
+			dprintf(CRITICAL, "scrub: Too many regions, skipping rest of %s\n",
+				name);
+			return;
+		}
+
+		r = &regions[region_count++];
+		r->name = name;
+		r->offset = offset + pos;
+		r->ptn_offset = pos;
+		r->size = MIN(size - pos, SCRUB_REGION_SIZE);
+	}
+}
+
+static void scrub_setup(void)
+{
+	char *name, *last;
+
+	mutex_init(&scrub_lock);
+	event_init(&scrub_resume, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+	for (name = strtok_r(scrub_names, ", ", &last); name;
+	     name = strtok_r(NULL, ", ", &last))
+		scrub_add_partition(name);
+
+	initialized = true;
+}
+
+/* Returns with the lock held, once no fastboot command is running */
+static void scrub_acquire(void)
+{
+	for (;;) {
+		mutex_acquire(&scrub_lock);
+		if (!paused)
+			return;
+
+		mutex_release(&scrub_lock);
+		event_wait(&scrub_resume);
+	}
+}
+
+static void scrub_chunk(struct scrub_region *r, uint32_t len)
+{
+	struct mmc_device *dev = target_mmc_device();
+	uint32_t block_size = mmc_get_device_blocksize();
+	bigtime_t start;
+	uint32_t us;
+
+	dma_map(scrub_buf, len, DMA_FROM_DEVICE);
+
+	start = current_time_hires();
+	if (mmc_sdhci_read(dev, scrub_buf, (r->offset + r->done) / block_size,
+			   len / block_size)) {
+		dprintf(CRITICAL, "scrub: Read error in %s @ %#x\n",
+			r->name, r->ptn_offset + r->done);
+		r->errors++;
+	}
+	us = current_time_hires() - start;
+
+	r->max_us = MAX(r->max_us, us);
+	r->total_us += us;
+	r->chunks++;
+	r->done += len;
+
+	if (len == SCRUB_CHUNK_SIZE && (!best_us || us < best_us))
+		best_us = us;
+}
+
+static int scrub_thread(void *arg)
+{
+	struct scrub_region *r;
+	uint32_t len;
+
+	for (r = regions; r < regions + region_count; r++) {
+		r->done = r->chunks = r->errors = 0;
+		r->max_us = r->total_us = 0;
+
+		while (r->done < r->size) {
+			len = MIN(r->size - r->done, SCRUB_CHUNK_SIZE);
+
+			scrub_acquire();
+			scrub_chunk(r, len);
+			mutex_release(&scrub_lock);
+
+			thread_sleep(SCRUB_INTERVAL_MS);
+		}
+	}
+
+	dprintf(INFO, "scrub: Done, %u regions\n", region_count);
+	running = false;
+	return 0;
+}
+
+void lk2nd_scrub_start(void)
+{
+	thread_t *thr;
+
+	if (!platform_boot_dev_isemmc() || running)
+		return;
+
+	if (!initialized)
+		scrub_setup();
+
+	if (!region_count)
+		return;
+
+	thr = thread_create("scrub", scrub_thread, NULL, LOW_PRIORITY,
+			    DEFAULT_STACK_SIZE);
+	if (!thr) {
+		dprintf(CRITICAL, "scrub: Failed to create thread\n");
+		return;
+	}
+
+	best_us = 0;
+	running = true;
+	thread_resume(thr);
+}
+
+void lk2nd_scrub_pause(void)
+{
+	paused++;
+
+	/* Wait for the chunk in flight */
+	if (initialized) {
+		mutex_acquire(&scrub_lock);
+		mutex_release(&scrub_lock);
+	}
+}
+
+void lk2nd_scrub_resume(void)
+{
+	if (--paused == 0 && initialized)
+		event_signal(&scrub_resume, false);
+}
+
+static bool scrub_region_slow(struct scrub_region *r)
+{
+	return r->errors || (best_us && r->max_us > SCRUB_SLOW_FACTOR * best_us);
+}
+
+/* Format a summary and the slow regions as text, returns the length */
+size_t lk2nd_scrub_report(char *buf, size_t size)
+{
+	struct scrub_region *r;
+	uint32_t done = 0, total = 0, slow = 0;
+	size_t len;
+
+	for (r = regions; r < regions + region_count; r++) {
+		done += r->done / 1024;
+		total += r->size / 1024;
+		if (scrub_region_slow(r))
+			slow++;
+	}
+
+	len = snprintf(buf, size,
+		       "scrub %s: %u/%u KiB, %u slow regions, best %u us per %u KiB\n",
+		       running ? "running" : "idle", done, total, slow,
+		       best_us, SCRUB_CHUNK_SIZE / 1024);
+
+	for (r = regions; r < regions + region_count && len < size; r++) {
+		if (!r->done || !scrub_region_slow(r))
+			continue;
+
+		len += snprintf(buf + len, size - len,
+			"%s @ %#x: %u KiB avg %u us max %u us, %u errors\n",
+			r->name, r->ptn_offset, r->done / 1024,
+			r->total_us / r->chunks, r->max_us,
+			r->errors);
+	}
+
+	return MIN(len, size);
+}
@@ -3,6 +3,7 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 OBJS += \
 	$(LOCAL_DIR)/lk2nd-device.o \
 	$(LOCAL_DIR)/lk2nd-fdt.o \
+	$(LOCAL_DIR)/lk2nd-mem.o \
 	$(LOCAL_DIR)/lk2nd-motorola.o \
 	$(LOCAL_DIR)/lk2nd-rproc.o \
 	$(LOCAL_DIR)/lk2nd-smd-rpm.o \
@@ -22,6 +23,49 @@ MODULES += lk2nd/smp
 DEFINES += SMP_SPIN_TABLE_BASE=$(SMP_SPIN_TABLE_BASE)
 endif
 
+ifneq ($(LK2ND_BOOT_HISTORY),)
+OBJS += $(LOCAL_DIR)/lk2nd-history.o
+DEFINES += LK2ND_BOOT_HISTORY=1
+CFLAGS += -DLK2ND_BOOT_HISTORY_PARTITION=\"$(LK2ND_BOOT_HISTORY)\"
+ifneq ($(LK2ND_BOOT_HISTORY_OFFSET),)
+DEFINES += LK2ND_BOOT_HISTORY_OFFSET=$(LK2ND_BOOT_HISTORY_OFFSET)
+endif
+endif
+
+ifneq ($(LK2ND_FSBOOT_STATE),)
+DEFINES += LK2ND_FSBOOT_STATE=1
+CFLAGS += -DLK2ND_FSBOOT_STATE_PARTITION=\"$(LK2ND_FSBOOT_STATE)\"
+ifneq ($(LK2ND_FSBOOT_STATE_OFFSET),)
+DEFINES += LK2ND_FSBOOT_STATE_OFFSET=$(LK2ND_FSBOOT_STATE_OFFSET)
+endif
+endif
+
+ifneq ($(LK2ND_BOOT_CACHE),)
+OBJS += $(LOCAL_DIR)/lk2nd-boot-cache.o
+DEFINES += LK2ND_BOOT_CACHE=1
+DEFINES += LK2ND_BOOT_CACHE_SIZE=$(LK2ND_BOOT_CACHE)
+endif
+
+ifneq ($(LK2ND_SCRUB),)
+OBJS += $(LOCAL_DIR)/lk2nd-scrub.o
+DEFINES += LK2ND_SCRUB=1
+CFLAGS += -DLK2ND_SCRUB_PARTITIONS=\"$(LK2ND_SCRUB)\"
+endif
+
+ifneq ($(LK2ND_PROFILE),)
+OBJS += $(LOCAL_DIR)/lk2nd-profile.o
+DEFINES += LK2ND_PROFILE=1
+ifneq ($(LK2ND_PROFILE_BOOT),)
+DEFINES += LK2ND_PROFILE_BOOT=$(LK2ND_PROFILE_BOOT)
+endif
+endif
+
+# Serial number from the whole eMMC CID, changes androidboot.serialno and the
+# MAC address derived from it
+ifneq ($(LK2ND_CID_SERIAL),)
+DEFINES += LK2ND_CID_SERIAL=1
+endif
+
 ifneq ($(LK1ST_DTB),)
 LK1ST_DTB_PATH := dts/$(TARGET)/$(LK1ST_DTB).dtb
 $(BUILDDIR)/$(LOCAL_DIR)/lk2nd-device.o: $(BUILDDIR)/$(LK1ST_DTB_PATH)
@@ -42,6 +86,11 @@ else ifeq ($(DISPLAY_USE_CONTINUOUS_SPLASH),1)
 OBJS := $(filter-out target/$(TARGET)/target_display.o target/$(TARGET)/oem_panel.o, $(OBJS))
 ifneq ($(filter $(DEFINES),DISPLAY_TYPE_MDSS=1),)
     OBJS += $(LOCAL_DIR)/target_display_cont_splash_mdp5.o
+    DEFINES += LK2ND_CONT_SPLASH=1
+    ifneq ($(DISPLAY_BACK_BUFFER_BASE),)
+        DEFINES += DISPLAY_BACK_BUFFER_BASE=$(DISPLAY_BACK_BUFFER_BASE)
+        DEFINES += DISPLAY_BACK_BUFFER_SIZE=$(DISPLAY_BACK_BUFFER_SIZE)
+    endif
 else
     $(error Continuous splash display is not supported for the current target)
 endif
@@ -45,6 +45,5 @@ status_t smb1360_enable_fg_access(const struct smb1360 *smb);
 void smb1360_disable_fg_access(const struct smb1360 *smb);
 status_t smb1360_check_cycle_stretch(const struct smb1360 *smb);
 status_t smb1360_reload(const struct smb1360 *smb);
-status_t smb1360_fg_reset(const struct smb1360 *smb);
 
 #endif
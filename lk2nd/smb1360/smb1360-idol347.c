@@ -5,7 +5,6 @@
 
 #include <debug.h>
 #include <pm8x41.h>
-#include <pm8x41_adc.h>
 #include "smb1360.h"
 
 static const struct smb1360_battery battery_tlp020k2 = {
@@ -19,9 +18,10 @@ static const struct smb1360_battery battery_tlk020kj = {
 };
 
 const struct smb1360_battery *smb1360_idol347_detect_battery(const struct smb1360 *smb,
-							     const void *fdt, int offset)
+							     const void *fdt, int offset,
+							     unsigned int attempt)
 {
-	uint32_t batt_id_uv = pm8x41_adc_channel_read(VADC_BAT_CHAN_ID);
+	uint32_t batt_id_uv = smb1360_read_batt_id_uv();
 
 	dprintf(SPEW, "idol347: batt_id_uv = %d\n", batt_id_uv);
 	if (batt_id_uv > 500000 && batt_id_uv < 700000) // ~606000
@@ -3,7 +3,6 @@
 #include <debug.h>
 #include <libfdt.h>
 #include <pm8x41.h>
-#include <pm8x41_adc.h>
 #include "smb1360.h"
 
 static const struct smb1360_battery batteryA = {
@@ -69,7 +68,7 @@ static uint32_t smb1360_parse_batt_id(const void *fdt, int offset)
 		return 0;
 	rpull = fdt32_to_cpu(*prop);
 
-	batt_id_uv = pm8x41_adc_channel_read(VADC_BAT_CHAN_ID);
+	batt_id_uv = smb1360_read_batt_id_uv();
 
 	if (batt_id_uv == 0)
 		return 0;
@@ -86,7 +85,8 @@ static uint32_t smb1360_parse_batt_id(const void *fdt, int offset)
 }
 
 const struct smb1360_battery *smb1360_qcom_detect_battery(const struct smb1360 *smb,
-							  const void *fdt, int offset)
+							  const void *fdt, int offset,
+							  unsigned int attempt)
 {
 	int len;
 	uint32_t connected_rid;
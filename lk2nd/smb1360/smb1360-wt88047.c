@@ -6,6 +6,7 @@
  */
 
 #include <debug.h>
+#include <kernel/thread.h>
 #include <pm8x41.h>
 #include <pm8x41_hw.h>
 #include <platform/timer.h>
@@ -305,9 +306,10 @@ static bool smb1360_wt88047_check_rsense_10mohm(const struct smb1360 *smb)
 }
 
 const struct smb1360_battery *smb1360_wt88047_detect_battery(const struct smb1360 *smb,
-							     const void *fdt, int offset)
+							     const void *fdt, int offset,
+							     unsigned int attempt)
 {
-	int delay_time, bat_module_id;
+	int bat_module_id;
 	struct pm8x41_gpio config = {
 		.direction = PM_GPIO_DIR_OUT,
 		.function = PM_GPIO_FUNC_LOW,
@@ -317,18 +319,16 @@ const struct smb1360_battery *smb1360_wt88047_detect_battery(const struct smb136
 		.out_strength = PM_GPIO_OUT_DRIVE_HIGH,
 	};
 
-	pm8x41_gpio_config(bq2022a_bat_id, &config);
+	/* Don't get preempted during PMIC accesses and the 1-wire timing */
+	enter_critical_section();
+	if (attempt == 0)
+		pm8x41_gpio_config(bq2022a_bat_id, &config);
 
-	for (delay_time = 5; delay_time < 10; delay_time++) {
-		bat_module_id = bq2022a_read_bat_id(delay_time, 1);
-		if (bat_module_id != 0xff)
-			break;
-		mdelay(10);
-	}
-
-	/* Failed to detect battery? */
+	/* Retry with increasing delay (5-9 us) for reading the bits */
+	bat_module_id = bq2022a_read_bat_id(5 + attempt, 1);
+	exit_critical_section();
 	if (bat_module_id == 0xff)
-		return NULL;
+		return attempt < 4 ? SMB1360_BATTERY_RETRY : NULL;
 
 	/*
 	 * For some reason, smb1360-charger-fg-wt88047.c sets rsense-10mohm
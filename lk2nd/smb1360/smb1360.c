@@ -1,13 +1,44 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #include <debug.h>
+#include <kernel/event.h>
+#include <kernel/thread.h>
 #include <libfdt.h>
 #include <lk2nd.h>
+#include <pm8x41_adc.h>
 #include "smb1360.h"
 
+/*
+ * Battery detection talks to the charger over bit-banged I2C and may need
+ * slow 1-wire/ADC reads with retries. It runs as a small state machine in
+ * the background while the rest of lk2nd keeps booting, sleeping on timers
+ * between the steps. The result is only waited for where it is needed.
+ */
+enum smb1360_state {
+	SMB1360_STATE_DETECT,
+	SMB1360_STATE_DONE,
+};
+
+/* Delay between detection attempts */
+#define SMB1360_RETRY_MS		10
+/* Give up waiting for the detection after this time */
+#define SMB1360_TIMEOUT_MS		5000
+
+struct smb1360_detect {
+	const struct smb1360_battery_detector *detector;
+	const void *fdt;
+	int offset;
+	enum smb1360_state state;
+	unsigned int attempt;
+	event_t done;
+};
+
+static struct smb1360_detect detect;
+
 struct smb1360_battery_detector {
 	const char *compatible;
 	const struct smb1360_battery *(*detect)(const struct smb1360 *smb,
-						const void *fdt, int offset);
+						const void *fdt, int offset,
+						unsigned int attempt);
 };
 
 static const struct smb1360_battery_detector detectors[] = {
@@ -39,31 +70,109 @@ static const struct smb1360_battery_detector *smb1360_match_detector(const void
 
 extern const struct smb1360 *smb1360_setup_i2c(const void *fdt, int offset);
 
-void smb1360_detect_battery(const void *fdt, int offset)
+/*
+ * The detection runs concurrently to the main thread, make sure it is not
+ * preempted in the middle of a PMIC transaction.
+ */
+uint32_t smb1360_read_batt_id_uv(void)
+{
+	uint32_t uv;
+
+	enter_critical_section();
+	uv = pm8x41_adc_channel_read(VADC_BAT_CHAN_ID);
+	exit_critical_section();
+
+	return uv;
+}
+
+static void smb1360_set_battery(const struct smb1360_battery *battery)
+{
+	if (!battery) {
+		dprintf(CRITICAL, "Failed to detect smb1360 battery\n");
+		lk2nd_dev.battery = "ERROR";
+		return;
+	}
+
+	dprintf(INFO, "Detected smb1360 battery: %s\n", battery->name);
+	lk2nd_dev.battery = battery->name;
+	lk2nd_dev.smb1360_battery = battery;
+}
+
+/* Run one step of the state machine, returns the delay until the next one */
+static int smb1360_step(struct smb1360_detect *d)
 {
-	const struct smb1360_battery_detector *detector;
 	const struct smb1360_battery *battery;
 
+	switch (d->state) {
+	case SMB1360_STATE_DETECT:
+		battery = d->detector->detect(lk2nd_dev.smb1360, d->fdt,
+					      d->offset, d->attempt);
+		if (battery == SMB1360_BATTERY_RETRY) {
+			d->attempt++;
+			return SMB1360_RETRY_MS;
+		}
+
+		smb1360_set_battery(battery);
+		d->state = SMB1360_STATE_DONE;
+		return 0;
+	case SMB1360_STATE_DONE:
+		break;
+	}
+	return 0;
+}
+
+static int smb1360_detect_thread(void *arg)
+{
+	struct smb1360_detect *d = arg;
+	int delay;
+
+	while (d->state != SMB1360_STATE_DONE) {
+		delay = smb1360_step(d);
+		if (delay)
+			thread_sleep(delay);
+	}
+
+	event_signal(&d->done, false);
+	return 0;
+}
+
+void smb1360_detect_battery(const void *fdt, int offset)
+{
+	thread_t *thr;
+
 	offset = fdt_subnode_offset(fdt, offset, "smb1360");
 	if (offset < 0)
 		return;
 
 	lk2nd_dev.smb1360 = smb1360_setup_i2c(fdt, offset);
 
-	detector = smb1360_match_detector(fdt, offset);
-	if (!detector)
+	detect.detector = smb1360_match_detector(fdt, offset);
+	if (!detect.detector)
 		return;
 
-	battery = detector->detect(lk2nd_dev.smb1360, fdt, offset);
-	if (!battery) {
-		dprintf(CRITICAL, "Failed to detect smb1360 battery\n");
-		lk2nd_dev.battery = "ERROR";
+	detect.fdt = fdt;
+	detect.offset = offset;
+	detect.state = SMB1360_STATE_DETECT;
+	event_init(&detect.done, false, 0);
+
+	thr = thread_create("smb1360", &smb1360_detect_thread, &detect,
+			    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+	if (!thr) {
+		dprintf(CRITICAL, "Failed to create smb1360 thread\n");
+		smb1360_detect_thread(&detect);
 		return;
 	}
 
-	dprintf(INFO, "Detected smb1360 battery: %s\n", battery->name);
-	lk2nd_dev.battery = battery->name;
-	lk2nd_dev.smb1360_battery = battery;
+	thread_resume(thr);
+}
+
+void smb1360_wait(void)
+{
+	if (!event_initialized(&detect.done))
+		return;
+
+	if (event_wait_timeout(&detect.done, SMB1360_TIMEOUT_MS))
+		dprintf(CRITICAL, "Timed out waiting for smb1360 battery detection\n");
 }
 
 static int smb1360_update_u32(void *fdt, int offset, const char *name, uint32_t val)
@@ -82,9 +191,12 @@ static int smb1360_update_u32(void *fdt, int offset, const char *name, uint32_t
 
 void smb1360_update_device_tree(void *fdt)
 {
-	const struct smb1360_battery *battery = lk2nd_dev.smb1360_battery;
+	const struct smb1360_battery *battery;
 	int offset, ret;
 
+	smb1360_wait();
+
+	battery = lk2nd_dev.smb1360_battery;
 	if (!battery)
 		return;
 
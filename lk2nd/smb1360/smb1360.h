@@ -20,14 +20,22 @@ struct smb1360_battery {
 	uint8_t *rslow_config;
 };
 
+/* Returned by detectors to be called again with the next attempt */
+#define SMB1360_BATTERY_RETRY	((const struct smb1360_battery *)-1)
+
 void smb1360_detect_battery(const void *fdt, int offset);
+void smb1360_wait(void);
+uint32_t smb1360_read_batt_id_uv(void);
 void smb1360_update_device_tree(void *fdt);
 
 const struct smb1360_battery *smb1360_idol347_detect_battery(const struct smb1360 *smb,
-							     const void *fdt, int offset);
+							     const void *fdt, int offset,
+							     unsigned int attempt);
 const struct smb1360_battery *smb1360_wt88047_detect_battery(const struct smb1360 *smb,
-							     const void *fdt, int offset);
+							     const void *fdt, int offset,
+							     unsigned int attempt);
 const struct smb1360_battery *smb1360_qcom_detect_battery(const struct smb1360 *smb,
-							  const void *fdt, int offset);
+							  const void *fdt, int offset,
+							  unsigned int attempt);
 
 #endif
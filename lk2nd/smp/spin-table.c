@@ -1,9 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-only
+#include <arch/defines.h>
+#include <arch/ops.h>
 #include <debug.h>
 #include <libfdt.h>
 #include <lk2nd.h>
 #include <psci.h>
 #include <scm.h>
+#include <stdlib.h>
 
 #include "cpu-boot.h"
 
@@ -12,6 +15,12 @@ struct smp_spin_table {
 	uint64_t release_addr;
 };
 
+/*
+ * Both loops are kept in the table at different offsets. CPUs parked in one
+ * of them keep running it while the other one is set up for the kernel.
+ */
+#define SMP_SPIN_TABLE_A32_OFFSET	0x800
+
 static uint8_t smp_spin_table_a64[] = {
 	0x5f, 0x20, 0x03, 0xd5,	/* wfe */
 	0xfe, 0x7f, 0x00, 0x58,	/* ldr	lr, 0x1000 */
@@ -20,12 +29,26 @@ static uint8_t smp_spin_table_a64[] = {
 };
 static uint8_t smp_spin_table_a32[] = {
 	0x02, 0xf0, 0x20, 0xe3,	/* wfe */
-	0xf4, 0xef, 0x9f, 0xe5,	/* ldr	lr, [pc, #4084] */
+	0xf4, 0xe7, 0x9f, 0xe5,	/* ldr	lr, [pc, #2036] */
 	0x00, 0x00, 0x5e, 0xe3,	/* cmp	lr, #0 */
 	0xfb, 0xff, 0xff, 0x0a,	/* beq	0 */
 	0x1e, 0xff, 0x2f, 0xe1,	/* bx	lr */
 };
 
+/* Execution state the secondary CPUs were parked in by smp_spin_table_park() */
+static enum {
+	SPIN_TABLE_NOT_PARKED,
+	SPIN_TABLE_PARKED_A32,
+	SPIN_TABLE_PARKED_A64,
+} spin_table_parked;
+
+/* Set once the loops were written by smp_spin_table_prepare() */
+static bool spin_table_written;
+
+#if TARGET_MSM8916
+static bool qhypstub_aarch64;
+#endif
+
 static int lkfdt_lookup_phandle(void *fdt, int node, const char *prop_name)
 {
 	const uint32_t *phandle;
@@ -40,46 +63,37 @@ static int lkfdt_lookup_phandle(void *fdt, int node, const char *prop_name)
 	return fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*phandle));
 }
 
-static void smp_spin_table_setup_cpu(struct smp_spin_table *table,
-				     void *fdt, int cpu_node)
+static int smp_spin_table_get_cpu(void *fdt, int cpu_node, uint32_t *cpu)
 {
 	const uint32_t *val;
-	int node, len, ret;
-	uint32_t cpu, base;
+	int len;
 
 	val = fdt_getprop(fdt, cpu_node, "reg", &len);
 	if (len != sizeof(*val)) {
 		dprintf(CRITICAL, "Cannot read reg property of CPU node: %d\n", len);
-		return;
-	}
-	cpu = fdt32_to_cpu(*val);
-	dprintf(INFO, "Booting CPU%x\n", cpu);
-
-	/* Adjust device tree with properties needed for spin-table */
-	ret = fdt_setprop_u64(fdt, cpu_node, "cpu-release-addr",
-			      (uintptr_t)&table->release_addr);
-	if (ret) {
-		dprintf(CRITICAL, "Failed to set cpu-release-addr: %d\n", ret);
-		return;
+		return -1;
 	}
+	*cpu = fdt32_to_cpu(*val);
+	return 0;
+}
 
-	ret = fdt_setprop_string(fdt, cpu_node, "enable-method", "spin-table");
-	if (ret) {
-		dprintf(CRITICAL, "Failed to update enable-method: %d\n", ret);
-		return;
-	}
+static int smp_spin_table_power_up_cpu(void *fdt, int cpu_node, uint32_t cpu)
+{
+	const uint32_t *val;
+	int node, len;
+	uint32_t base;
 
 	/* Power up the CPU core using registers in the ACC node */
 	node = lkfdt_lookup_phandle(fdt, cpu_node, "qcom,acc");
 	if (node < 0) {
 		dprintf(CRITICAL, "Cannot find qcom,acc node: %d\n", node);
-		return;
+		return node;
 	}
 
 	val = fdt_getprop(fdt, node, "reg", &len);
 	if (len < sizeof(*val)) {
 		dprintf(CRITICAL, "Cannot read reg property of qcom,acc node: %d\n", len);
-		return;
+		return -FDT_ERR_BADVALUE;
 	}
 	base = fdt32_to_cpu(*val);
 
@@ -89,24 +103,55 @@ static void smp_spin_table_setup_cpu(struct smp_spin_table *table,
 	node = lkfdt_lookup_phandle(fdt, cpu_node, "next-level-cache");
 	if (node < 0) {
 		dprintf(CRITICAL, "Cannot find next-level-cache: %d\n", node);
-		return;
+		return node;
 	}
 
 	node = lkfdt_lookup_phandle(fdt, node, "qcom,saw");
 	if (node < 0) {
 		dprintf(CRITICAL, "Cannot find L2 SAW node: %d\n", node);
-		return;
+		return node;
 	}
 
 	val = fdt_getprop(fdt, node, "reg", &len);
 	if (len < sizeof(*val)) {
 		dprintf(CRITICAL, "Cannot read reg property of L2 qcom,saw node: %d\n", len);
-		return;
+		return -FDT_ERR_BADVALUE;
 	}
 	qcom_power_up_kpssv2(cpu, base, fdt32_to_cpu(*val));
 #else
 #error Unsupported target for CPU spin-table!
 #endif
+	return 0;
+}
+
+static void smp_spin_table_setup_cpu(struct smp_spin_table *table,
+				     void *fdt, int cpu_node, bool power_up)
+{
+	int node, ret;
+	uint32_t cpu;
+
+	if (smp_spin_table_get_cpu(fdt, cpu_node, &cpu))
+		return;
+
+	/* Adjust device tree with properties needed for spin-table */
+	ret = fdt_setprop_u64(fdt, cpu_node, "cpu-release-addr",
+			      (uintptr_t)&table->release_addr);
+	if (ret) {
+		dprintf(CRITICAL, "Failed to set cpu-release-addr: %d\n", ret);
+		return;
+	}
+
+	ret = fdt_setprop_string(fdt, cpu_node, "enable-method", "spin-table");
+	if (ret) {
+		dprintf(CRITICAL, "Failed to update enable-method: %d\n", ret);
+		return;
+	}
+
+	if (power_up) {
+		dprintf(INFO, "Booting CPU%x\n", cpu);
+		if (smp_spin_table_power_up_cpu(fdt, cpu_node, cpu))
+			return;
+	}
 
 	/* Enable the SAW/SPM node for CPU idle functionality */
 	node = lkfdt_lookup_phandle(fdt, cpu_node, "qcom,saw");
@@ -163,18 +208,130 @@ static void smp_spin_table_setup_idle_states(void *fdt, int node)
  * in EL1 instead of EL2 (assuming it was bypassed for the state switch).
  * To avoid that, force execution state to aarch64.
  */
+extern void qhypstub_set_state_aarch32(void);
 extern void qhypstub_set_state_aarch64(void);
 
+static bool smp_spin_table_psci_supported(uint32_t *version)
+{
+	scmcall_arg arg = {PSCI_0_2_FN_PSCI_VERSION};
+
+	if (!is_scm_armv8_support())
+		return false;
+
+	*version = scm_call2(&arg, NULL);
+	return *version != PSCI_RET_NOT_SUPPORTED;
+}
+
+static int smp_spin_table_prepare(struct smp_spin_table *table, bool arm64)
+{
+	uint8_t *entry = table->code;
+	int ret;
+
+	/* Never rewrite the code while parked CPUs might be executing it */
+	if (!spin_table_written) {
+		memcpy(table->code, smp_spin_table_a64, sizeof(smp_spin_table_a64));
+		memcpy(table->code + SMP_SPIN_TABLE_A32_OFFSET, smp_spin_table_a32,
+		       sizeof(smp_spin_table_a32));
+		table->release_addr = 0;
+
+		/* The CPUs start with MMU and caches disabled */
+		arch_clean_invalidate_cache_range((addr_t)table, sizeof(*table));
+		spin_table_written = true;
+	}
+
+	if (!arm64)
+		entry += SMP_SPIN_TABLE_A32_OFFSET;
+
+	ret = qcom_set_boot_addr((uint32_t)entry, arm64);
+	if (ret) {
+		dprintf(CRITICAL, "Failed to set CPU boot address: %d\n", ret);
+		return ret;
+	}
+
+#if TARGET_MSM8916
+	if (arm64)
+		qhypstub_set_state_aarch64();
+	else if (qhypstub_aarch64)
+		qhypstub_set_state_aarch32();
+	qhypstub_aarch64 = arm64;
+#endif
+	return 0;
+}
+
+/*
+ * Power up the secondary CPUs early during boot and park them in the
+ * spin-table WFE loop, so that the (slow) power-up sequence does not have
+ * to run right before jumping to the kernel. The CPU nodes in the lk2nd
+ * device tree are used to find the ACC registers.
+ *
+ * The execution state of the kernel is not known yet at this point, so
+ * guess aarch64 if the firmware supports it. smp_spin_table_setup() will
+ * boot the CPUs again if the guess turns out to be wrong.
+ */
+void smp_spin_table_park(struct smp_spin_table *table, void *fdt)
+{
+	uint32_t psci_version, cpu;
+	bool arm64 = is_scm_armv8_support();
+	int offset, node;
+
+	if (!fdt || smp_spin_table_psci_supported(&psci_version))
+		return;
+
+	offset = fdt_path_offset(fdt, "/cpus");
+	if (offset < 0)
+		return;
+
+	/* Check that all CPUs can be powered up before touching any of them */
+	fdt_for_each_subnode(node, fdt, offset) {
+		const char *name;
+		int len;
+
+		name = fdt_get_name(fdt, node, &len);
+		if (len < strlen("cpu@") || name[len] ||
+		    strncmp(name, "cpu@", strlen("cpu@")) != 0)
+			continue;
+
+		if (fdt_getprop(fdt, node, "qcom,acc", NULL) == NULL) {
+			dprintf(INFO, "No qcom,acc for %s, not parking CPUs early\n", name);
+			return;
+		}
+	}
+	if (node < 0 && node != -FDT_ERR_NOTFOUND)
+		return;
+
+	if (smp_spin_table_prepare(table, arm64))
+		return;
+
+	fdt_for_each_subnode(node, fdt, offset) {
+		const char *name;
+		int len;
+
+		name = fdt_get_name(fdt, node, &len);
+		if (len < strlen("cpu@") || name[len] ||
+		    strncmp(name, "cpu@", strlen("cpu@")) != 0)
+			continue;
+
+		if (smp_spin_table_get_cpu(fdt, node, &cpu))
+			return;
+
+		dprintf(INFO, "Parking CPU%x in spin-table (%s)\n", cpu,
+			arm64 ? "aarch64" : "aarch32");
+		if (smp_spin_table_power_up_cpu(fdt, node, cpu))
+			return;
+	}
+
+	spin_table_parked = arm64 ? SPIN_TABLE_PARKED_A64 : SPIN_TABLE_PARKED_A32;
+}
+
 void smp_spin_table_setup(struct smp_spin_table *table, void *fdt,
 			  bool arm64, bool force)
 {
+	uint32_t psci_version;
+	bool power_up = true;
 	int offset, node, ret;
 
 	if (is_scm_armv8_support()) {
-		scmcall_arg arg = {PSCI_0_2_FN_PSCI_VERSION};
-		uint32_t psci_version = scm_call2(&arg, NULL);
-
-		if (psci_version != PSCI_RET_NOT_SUPPORTED) {
+		if (smp_spin_table_psci_supported(&psci_version)) {
 			dprintf(INFO, "PSCI v%d.%d detected, no need for SMP spin table\n",
 				PSCI_VERSION_MAJOR(psci_version), PSCI_VERSION_MINOR(psci_version));
 			if (!force)
@@ -221,24 +378,19 @@ void smp_spin_table_setup(struct smp_spin_table *table, void *fdt,
 		return;
 	}
 
-	if (arm64)
-		memcpy(table->code, smp_spin_table_a64, sizeof(smp_spin_table_a64));
-	else
-		memcpy(table->code, smp_spin_table_a32, sizeof(smp_spin_table_a32));
-
-	table->release_addr = 0;
-
-	ret = qcom_set_boot_addr((uint32_t)table, arm64);
-	if (ret) {
-		dprintf(CRITICAL, "Failed to set CPU boot address: %d\n", ret);
+	/*
+	 * The CPUs are already waiting in the right spin-table loop if they
+	 * were parked early, so only the device tree needs to be updated.
+	 * Otherwise (re)start them, the power-up sequence resets CPUs that
+	 * were parked in the wrong execution state.
+	 */
+	if (spin_table_parked == (arm64 ? SPIN_TABLE_PARKED_A64 : SPIN_TABLE_PARKED_A32)) {
+		dprintf(INFO, "CPUs were parked early, skipping power-up\n");
+		power_up = false;
+	} else if (smp_spin_table_prepare(table, arm64)) {
 		return;
 	}
 
-#if TARGET_MSM8916
-	if (arm64)
-		qhypstub_set_state_aarch64();
-#endif
-
 	fdt_for_each_subnode(node, fdt, offset) {
 		const char *name;
 		int len;
@@ -247,7 +399,7 @@ void smp_spin_table_setup(struct smp_spin_table *table, void *fdt,
 		if (len < strlen("cpu@") || name[len])
 			continue;
 		if (strncmp(name, "cpu@", strlen("cpu@")) == 0)
-			smp_spin_table_setup_cpu(table, fdt, node);
+			smp_spin_table_setup_cpu(table, fdt, node, power_up);
 		if (strcmp(name, "idle-states") == 0)
 			smp_spin_table_setup_idle_states(fdt, node);
 	}
@@ -255,4 +407,8 @@ void smp_spin_table_setup(struct smp_spin_table *table, void *fdt,
 		dprintf(CRITICAL, "Failed to read /cpus subnodes: %d\n", node);
 		return;
 	}
+
+	/* The CPUs keep spinning on the table until the kernel releases them */
+	lk2nd_mem_reserve("spin-table", (uintptr_t)table,
+			  ROUNDUP(sizeof(*table), PAGE_SIZE), NULL);
 }
@@ -1,13 +1,18 @@
 #include <arch/defines.h>
+#include <arch/ops.h>
 #include <bits.h>
 #include <debug.h>
+#include <libfdt.h>
+#include <printf.h>
 #include <reg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <target.h>
 
 #include <dev/fbcon.h>
 #include <kernel/event.h>
 #include <kernel/thread.h>
+#include <lk2nd.h>
 #include <mdp5.h>
 #include <platform.h>
 #include <platform/clock.h>
@@ -27,6 +32,7 @@ static struct fbcon_config fb = {
 struct pipe {
 	unsigned int base;
 	uint32_t type;
+	uint32_t flush;
 };
 
 /*
@@ -37,29 +43,53 @@ static const struct pipe pipes[] = {
 	{
 		.base = MDP_VP_0_RGB_0_BASE,
 		.type = MDSS_MDP_PIPE_TYPE_RGB,
+		.flush = BIT(3),
 	},
 	{
 		.base = MDP_VP_0_VIG_0_BASE,
 		.type = MDSS_MDP_PIPE_TYPE_VIG,
+		.flush = BIT(0),
 	},
 	{
 		.base = MDP_VP_0_DMA_0_BASE,
 		.type = MDSS_MDP_PIPE_TYPE_DMA,
+		.flush = BIT(11),
 	},
 };
 
+static const struct pipe *active_pipe;
+static void *splash_base;
+
 extern int check_aboot_addr_range_overlap(uintptr_t start, uint32_t size);
 extern int check_ddr_addr_range_bound(uintptr_t start, uint32_t size);
 
 static event_t refresh_event;
+static void * volatile pending_flip;
+static time_t flip_time;
+
+static void mdp5_set_pipe_addr(void *base)
+{
+	writel((uint32_t) base, active_pipe->base + PIPE_SSPP_SRC0_ADDR);
+	writel(active_pipe->flush, MDP_CTL_BASE + CTL_FLUSH);
+}
 
 static int mdp5_cmd_refresh_loop(void *data)
 {
+	void *flip;
+
 	while (true) {
 		event_wait(&refresh_event);
 		event_unsignal(&refresh_event);
 
+		/* Switch buffers as part of the kickoff, never during a transfer */
+		flip = pending_flip;
+		if (flip)
+			mdp5_set_pipe_addr(flip);
+
 		writel(1, MDP_CTL_BASE + CTL_START);
+		if (flip)
+			pending_flip = NULL;
+
 		/* Limit to 50 Hz to prevent overlapping display updates */
 		thread_sleep(20);
 	}
@@ -72,6 +102,37 @@ static void mdp5_cmd_signal_refresh(void)
 	event_signal(&refresh_event, false);
 }
 
+static void mdp5_cmd_flip(void *base)
+{
+	pending_flip = base;
+	mdp5_cmd_signal_refresh();
+}
+
+static int mdp5_cmd_flip_done(void)
+{
+	return !pending_flip;
+}
+
+static void mdp5_video_flip(void *base)
+{
+	/* The new address is latched by the hardware on the next vsync */
+	mdp5_set_pipe_addr(base);
+	flip_time = current_time();
+}
+
+static int mdp5_video_flip_done(void)
+{
+	if (!(readl(MDP_CTL_BASE + CTL_FLUSH) & active_pipe->flush))
+		return 1;
+
+	/* Avoid hanging forever if the display stopped fetching frames */
+	if (current_time() - flip_time > 100) {
+		dprintf(CRITICAL, "Timeout waiting for display flip\n");
+		return 1;
+	}
+	return 0;
+}
+
 static void mdp5_cmd_start_refresh(struct fbcon_config *fb)
 {
 	thread_t *thr;
@@ -89,6 +150,50 @@ static void mdp5_cmd_start_refresh(struct fbcon_config *fb)
 	fb->update_start = mdp5_cmd_signal_refresh;
 }
 
+#ifdef DISPLAY_BACK_BUFFER_BASE
+static void mdp5_setup_back_buffer(struct fbcon_config *fb, bool cmd_mode,
+				   uint32_t size)
+{
+	if (size > DISPLAY_BACK_BUFFER_SIZE) {
+		dprintf(INFO, "Display back buffer too small (need %u bytes), "
+			"drawing directly to screen\n", size);
+		return;
+	}
+
+#if WITH_DEBUG_FBCON
+	/*
+	 * The log console scrolls a lot: rather than moving the whole screen
+	 * for every line, pan over the back buffer if it fits two screens.
+	 */
+	if (DISPLAY_BACK_BUFFER_SIZE / size >= 2) {
+		fb->scroll_base = (void*) platform_map_fb(DISPLAY_BACK_BUFFER_BASE,
+							  DISPLAY_BACK_BUFFER_SIZE);
+		fb->scroll_height = DISPLAY_BACK_BUFFER_SIZE / (size / fb->height);
+	}
+	if (!fb->scroll_base)
+#endif
+	fb->back = (void*) platform_map_fb(DISPLAY_BACK_BUFFER_BASE, size);
+	if (!fb->back && !fb->scroll_base) {
+		dprintf(CRITICAL, "Failed to map display back buffer\n");
+		return;
+	}
+
+	if (cmd_mode) {
+		/* Without the refresh thread there is nothing to flip the buffers */
+		if (!fb->update_start) {
+			fb->back = NULL;
+			fb->scroll_base = NULL;
+			return;
+		}
+		fb->flip = mdp5_cmd_flip;
+		fb->update_done = mdp5_cmd_flip_done;
+	} else {
+		fb->flip = mdp5_video_flip;
+		fb->update_done = mdp5_video_flip_done;
+	}
+}
+#endif
+
 static int mdp5_read_config(struct fbcon_config *fb)
 {
 	const struct pipe *pipe = pipes, *pipe_end = pipe + ARRAY_SIZE(pipes);
@@ -104,6 +209,7 @@ static int mdp5_read_config(struct fbcon_config *fb)
 		dprintf(CRITICAL, "No continuous splash: cannot find active pipe\n");
 		return -1;
 	}
+	active_pipe = pipe;
 
 	stride = readl(pipe->base + PIPE_SSPP_SRC_YSTRIDE);
 	src_size = readl(pipe->base + PIPE_SSPP_SRC_IMG_SIZE);
@@ -148,6 +254,11 @@ static int mdp5_read_config(struct fbcon_config *fb)
 		dprintf(CRITICAL, "Failed to map continuous splash memory region\n");
 		return -1;
 	}
+	splash_base = fb->base;
+
+#ifdef DISPLAY_BACK_BUFFER_BASE
+	mdp5_setup_back_buffer(fb, cmd_mode, size);
+#endif
 
 	return 0;
 }
@@ -171,4 +282,216 @@ void target_display_init(const char *panel_name)
 
 	// Setup framebuffer
 	fbcon_setup(&fb);
+
+	/* The display keeps scanning out the splash framebuffer after boot */
+	lk2nd_mem_reserve("cont-splash", (uintptr_t)splash_base,
+			  ROUNDUP(fb.stride * (fb.bpp/8) * fb.height, PAGE_SIZE),
+			  "simple-framebuffer");
+}
+
+void target_display_shutdown(void)
+{
+	uint32_t size;
+
+	/* The kernel expects the framebuffer that was set up at boot */
+	if (!fb.flip || fb.back == splash_base)
+		return;
+
+	size = fb.stride * (fb.bpp/8) * fb.height;
+	if (fb.scroll_base) {
+		/* Move the scrolled console back to the original framebuffer */
+		memcpy(splash_base, fb.base, size);
+		fb.base = splash_base;
+	}
+	arch_clean_invalidate_cache_range((addr_t) fb.base, size);
+	fb.flip(fb.base);
+	while (!fb.update_done());
+
+	/* Anything drawn from now on goes directly to the screen */
+	fb.flip = NULL;
+	fb.back = NULL;
+	fb.scroll_base = NULL;
+	fb.update_done = NULL;
+}
+
+static int mdp5_simplefb_set_reg(void *fdt, int node, uint64_t base, uint64_t size)
+{
+	int parent = fdt_parent_offset(fdt, node);
+	int addr_cells = fdt_address_cells(fdt, parent);
+	int size_cells = fdt_size_cells(fdt, parent);
+	fdt32_t reg[4], *cell = reg;
+
+	if (addr_cells < 1 || addr_cells > 2 || size_cells < 1 || size_cells > 2)
+		return -FDT_ERR_BADNCELLS;
+
+	if (addr_cells == 2)
+		*cell++ = cpu_to_fdt32(base >> 32);
+	*cell++ = cpu_to_fdt32(base);
+	if (size_cells == 2)
+		*cell++ = cpu_to_fdt32(size >> 32);
+	*cell++ = cpu_to_fdt32(size);
+
+	return fdt_setprop(fdt, node, "reg", reg, (cell - reg) * sizeof(*reg));
+}
+
+/* Get (or add) a child of the root node in the same address space */
+static int mdp5_simplefb_get_bus(void *fdt, const char *name)
+{
+	int node, ret;
+
+	node = fdt_subnode_offset(fdt, 0, name);
+	if (node < 0)
+		node = fdt_add_subnode(fdt, 0, name);
+	if (node < 0)
+		return node;
+
+	if (fdt_getprop(fdt, node, "#address-cells", NULL))
+		return node;
+
+	ret = fdt_setprop_u32(fdt, node, "#address-cells", fdt_address_cells(fdt, 0));
+	if (ret)
+		return ret;
+	ret = fdt_setprop_u32(fdt, node, "#size-cells", fdt_size_cells(fdt, 0));
+	if (ret)
+		return ret;
+	ret = fdt_setprop_empty(fdt, node, "ranges");
+	if (ret)
+		return ret;
+
+	return node;
+}
+
+/*
+ * Describe the framebuffer memory in /reserved-memory, referenced by
+ * memory-region, so the kernel can free it once the display driver
+ * has taken over. Returns the phandle of the node.
+ */
+static int mdp5_simplefb_add_region(void *fdt, uint64_t base, uint64_t size,
+				    uint32_t *phandle)
+{
+	char name[32];
+	int rmem, node, ret;
+
+	rmem = mdp5_simplefb_get_bus(fdt, "reserved-memory");
+	if (rmem < 0)
+		return rmem;
+
+	snprintf(name, sizeof(name), "framebuffer@%llx", base);
+	node = fdt_add_subnode(fdt, rmem, name);
+	if (node < 0)
+		return node;
+
+	ret = mdp5_simplefb_set_reg(fdt, node, base, size);
+	if (ret)
+		return ret;
+
+	ret = fdt_generate_phandle(fdt, phandle);
+	if (ret)
+		return ret;
+
+	return fdt_setprop_u32(fdt, node, "phandle", *phandle);
+}
+
+static int mdp5_simplefb_find_node(void *fdt)
+{
+	char name[32];
+	int node, chosen, ret;
+
+	/*
+	 * Prefer an enabled node prepared in the device tree (e.g. with clocks).
+	 * Disabled nodes and nodes that already describe some framebuffer
+	 * memory are not ours to take over.
+	 */
+	for (node = fdt_node_offset_by_compatible(fdt, -1, "simple-framebuffer");
+	     node >= 0;
+	     node = fdt_node_offset_by_compatible(fdt, node, "simple-framebuffer")) {
+		if (!lkfdt_node_is_available(fdt, node))
+			continue;
+		if (fdt_getprop(fdt, node, "reg", NULL) ||
+		    fdt_getprop(fdt, node, "memory-region", NULL))
+			return -FDT_ERR_EXISTS;
+		return node;
+	}
+
+	/* Children of /chosen are in the same address space as the root node */
+	chosen = mdp5_simplefb_get_bus(fdt, "chosen");
+	if (chosen < 0)
+		return chosen;
+
+	snprintf(name, sizeof(name), "framebuffer@%lx", (uintptr_t)splash_base);
+	node = fdt_add_subnode(fdt, chosen, name);
+	if (node < 0)
+		return node;
+
+	ret = fdt_setprop_string(fdt, node, "compatible", "simple-framebuffer");
+	if (ret)
+		return ret;
+
+	return node;
+}
+
+/*
+ * Hand the continuous splash framebuffer over to the kernel as
+ * simple-framebuffer. This way the panel keeps showing the same image
+ * until the display driver takes over, without blanking or redrawing it.
+ */
+void lk2nd_cont_splash_update_device_tree(void *fdt)
+{
+	uint32_t stride = fb.stride * (fb.bpp/8);
+	uint32_t size = stride * fb.height;
+	uint32_t phandle;
+	int node, ret;
+
+	if (!splash_base)
+		return;
+
+	node = mdp5_simplefb_find_node(fdt);
+	if (node < 0) {
+		ret = node;
+		goto err;
+	}
+
+	ret = mdp5_simplefb_add_region(fdt, (uintptr_t)splash_base,
+				       ROUNDUP(size, PAGE_SIZE), &phandle);
+	if (ret)
+		goto err;
+
+	/* Adding the region moved the nodes, look it up again */
+	node = mdp5_simplefb_find_node(fdt);
+	if (node < 0) {
+		ret = node;
+		goto err;
+	}
+
+	ret = mdp5_simplefb_set_reg(fdt, node, (uintptr_t)splash_base, size);
+	if (ret)
+		goto err;
+
+	ret = fdt_setprop_u32(fdt, node, "memory-region", phandle);
+	if (ret)
+		goto err;
+	ret = fdt_setprop_u32(fdt, node, "width", fb.width);
+	if (ret)
+		goto err;
+	ret = fdt_setprop_u32(fdt, node, "height", fb.height);
+	if (ret)
+		goto err;
+	ret = fdt_setprop_u32(fdt, node, "stride", stride);
+	if (ret)
+		goto err;
+	ret = fdt_setprop_string(fdt, node, "format", "r8g8b8");
+	if (ret)
+		goto err;
+	ret = fdt_setprop_string(fdt, node, "status", "okay");
+	if (ret)
+		goto err;
+
+	dprintf(INFO, "Continuous splash framebuffer passed to kernel: %p (%ux%u)\n",
+		splash_base, fb.width, fb.height);
+	return;
+
+err:
+	dprintf(CRITICAL, "Failed to add simple-framebuffer node: %d\n", ret);
+	/* The kernel does not know about it, so it may use the memory */
+	lk2nd_mem_release((uintptr_t)splash_base);
 }
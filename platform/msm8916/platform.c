@@ -38,6 +38,7 @@
 #include <board.h>
 #include <boot_stats.h>
 #include <platform.h>
+#include <stdlib.h>
 #include <target/display.h>
 
 #define MSM_IOMAP_SIZE ((MSM_IOMAP_END - MSM_IOMAP_BASE)/MB)
@@ -57,6 +58,9 @@
 #define SCRATCH_MEMORY       (MMU_MEMORY_TYPE_NORMAL_WRITE_BACK_ALLOCATE | \
                            MMU_MEMORY_AP_READ_WRITE | MMU_MEMORY_XN)
 
+/* Initially mapped part of the scratch region (in MB), see platform_map_scratch() */
+#define SCRATCH_MAP_SIZE     256
+
 static mmu_section_t mmu_section_table[] = {
 /*           Physical addr,     Virtual addr,     Size (in MB),     Flags */
 	{    MEMBASE,           MEMBASE,          (MEMSIZE / MB),   LK_MEMORY},
@@ -65,7 +69,7 @@ static mmu_section_t mmu_section_table[] = {
 	{    SYSTEM_IMEM_BASE,  SYSTEM_IMEM_BASE, 1,                COMMON_MEMORY},
 	{    MSM_SHARED_BASE,   MSM_SHARED_BASE,  1,                COMMON_MEMORY},
 	{    MIPI_FB_ADDR,      MIPI_FB_ADDR,     10,              COMMON_MEMORY},
-	{    SCRATCH_ADDR,      SCRATCH_ADDR,     256,              SCRATCH_MEMORY},
+	{    SCRATCH_ADDR,      SCRATCH_ADDR,     SCRATCH_MAP_SIZE, SCRATCH_MEMORY},
         {    RPMB_SND_RCV_BUF,      RPMB_SND_RCV_BUF,        RPMB_SND_RCV_BUF_SZ,    IOMAP_MEMORY},
 	{    0x86400000,      0x86400000,     1,              COMMON_MEMORY},
 #ifdef SMP_SPIN_TABLE_BASE
@@ -159,6 +163,22 @@ void platform_init_mmu_mappings(void)
 	}
 }
 
+/* Extend the scratch mapping if the scratch region is larger than 256 MB */
+void platform_map_scratch(uint32_t size)
+{
+	static uint32_t mapped = SCRATCH_MAP_SIZE * MB;
+	addr_t addr;
+
+	if (size <= mapped)
+		return;
+
+	for (addr = SCRATCH_ADDR + mapped; addr < SCRATCH_ADDR + size; addr += MB)
+		arm_mmu_map_section(addr, addr, SCRATCH_MEMORY);
+	arm_mmu_flush();
+
+	mapped = ROUNDUP(size, MB);
+}
+
 addr_t platform_map_fb(addr_t phys_addr, uint32_t size)
 {
 	if (phys_addr != MIPI_FB_ADDR) {
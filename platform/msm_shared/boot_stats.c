@@ -32,11 +32,17 @@
 #include <platform/iomap.h>
 
 static uint32_t kernel_load_start;
+static uint32_t bs_timestamps[BS_MAX];
+
 void bs_set_timestamp(enum bs_entry bs_id)
 {
 	addr_t bs_imem = get_bs_info_addr();
 	uint32_t clk_count = 0;
 
+	/* Keep a copy, also if there is no IMEM area to write to */
+	if (bs_id < BS_MAX)
+		bs_timestamps[bs_id] = platform_get_sclk_count();
+
 	if(bs_imem) {
 		if (bs_id >= BS_MAX) {
 			dprintf(CRITICAL, "bad bs id: %u, max: %u\n", bs_id, BS_MAX);
@@ -64,3 +70,12 @@ void bs_set_timestamp(enum bs_entry bs_id)
 		}
 	}
 }
+
+/* Sleep clock count when bs_id was reached, or 0 if not reached (yet) */
+uint32_t bs_get_timestamp(enum bs_entry bs_id)
+{
+	if (bs_id >= BS_MAX)
+		return 0;
+
+	return bs_timestamps[bs_id];
+}
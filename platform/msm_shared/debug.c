@@ -36,6 +36,7 @@
 #include <arch/arm/dcc.h>
 #include <dev/fbcon.h>
 #include <dev/uart.h>
+#include <kernel/thread.h>
 #include <platform/timer.h>
 #include <platform.h>
 
@@ -101,6 +102,108 @@ char* lk_log_getbuf(void) {
 unsigned lk_log_getsize(void) {
     return log.header.size_written;
 }
+unsigned lk_log_getmaxsize(void) {
+    return log.header.max_size;
+}
+
+/*
+ * Message log: every dprintf() message gets a record with its time stamp,
+ * level and position in the log buffer above, so the text itself is only
+ * stored once. lk_log_message() writes the text and its record in one
+ * critical section, so messages from interrupt handlers and threads never
+ * interleave in the buffer. There is a single ring of records, lk2nd only
+ * runs on one CPU.
+ */
+#ifndef LK_LOG_RECORDS
+#define LK_LOG_RECORDS     512
+#endif
+
+struct lk_log_record {
+	unsigned time_us;
+	unsigned start;		/* position in size_written */
+	unsigned short len;
+	uint8_t level;
+};
+
+static struct lk_log_record log_records[LK_LOG_RECORDS];
+static unsigned log_record_count;
+
+static void debug_putc(char c);
+
+static void log_puts(const char *str)
+{
+	while (*str)
+		log_putc(*str++);
+}
+
+static void debug_puts(const char *str)
+{
+	while (*str)
+		debug_putc(*str++);
+}
+
+void lk_log_message(int level, const char *prefix, const char *msg)
+{
+	struct lk_log_record *r;
+	unsigned start;
+
+	enter_critical_section();
+	log_puts(prefix);
+	start = log.header.size_written;
+	log_puts(msg);
+
+	r = &log_records[log_record_count++ % LK_LOG_RECORDS];
+	r->time_us = current_time_hires();
+	r->start = start;
+	r->len = MIN(log.header.size_written - start, 0xffff);
+	r->level = level;
+	exit_critical_section();
+
+	/* The other outputs are slow, keep interrupts enabled for them */
+	debug_puts(prefix);
+	debug_puts(msg);
+}
+
+/*
+ * Format the messages whose text is still in the log buffer as
+ * "[seconds.us] <level> text". Returns the length.
+ */
+size_t lk_log_read(char *buf, size_t size)
+{
+	unsigned max_size = log.header.max_size;
+	unsigned i, j, end;
+	struct lk_log_record *r;
+	size_t len = 0;
+	int n;
+
+	enter_critical_section();
+	end = log_record_count;
+	i = end > LK_LOG_RECORDS ? end - LK_LOG_RECORDS : 0;
+	exit_critical_section();
+
+	for (; i != end && len < size; i++) {
+		enter_critical_section();
+		r = &log_records[i % LK_LOG_RECORDS];
+
+		/* Skip records and text that were overwritten in the meantime */
+		if (log_record_count - i > LK_LOG_RECORDS ||
+		    log.header.size_written - r->start > max_size) {
+			exit_critical_section();
+			continue;
+		}
+
+		n = snprintf(buf + len, size - len, "[%u.%06u] <%u> ",
+			     r->time_us / 1000000, r->time_us % 1000000,
+			     r->level);
+		len = MIN(len + n, size);
+
+		for (j = 0; j < r->len && len < size; j++)
+			buf[len++] = log.data[(r->start + j) % max_size];
+		exit_critical_section();
+	}
+
+	return len;
+}
 #endif /* WITH_DEBUG_LOG_BUF */
 
 void display_fbcon_message(char *str)
@@ -111,11 +214,9 @@ void display_fbcon_message(char *str)
 	}
 #endif
 }
-void _dputc(char c)
+/* All outputs except the log buffer */
+static void debug_putc(char c)
 {
-#if WITH_DEBUG_LOG_BUF
-	log_putc(c);
-#endif
 #if WITH_DEBUG_DCC
 	if (c == '\n') {
 		write_dcc('\r');
@@ -125,7 +226,8 @@ void _dputc(char c)
 #if WITH_DEBUG_UART
 	uart_putc(0, c);
 #endif
-#if WITH_DEBUG_FBCON && WITH_DEV_FBCON
+#if WITH_DEBUG_FBCON && WITH_DEV_FBCON && !WITH_DEBUG_LOG_BUF
+	/* With the log buffer, fbcon draws it asynchronously */
 	fbcon_putc(c);
 #endif
 #if WITH_DEBUG_JTAG
@@ -133,6 +235,14 @@ void _dputc(char c)
 #endif
 }
 
+void _dputc(char c)
+{
+#if WITH_DEBUG_LOG_BUF
+	log_putc(c);
+#endif
+	debug_putc(c);
+}
+
 int dgetc(char *c, bool wait)
 {
 	int n;
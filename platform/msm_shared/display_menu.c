@@ -40,9 +40,12 @@
 #include <target.h>
 #include <sys/types.h>
 #include <../../../app/aboot/devinfo.h>
+#include <fs_boot.h>
 #include <lk2nd.h>
 #if TARGET_MSM8916
 #include <psci.h>
+
+extern void smb1360_wait(void);
 #endif
 
 static const char *unlock_menu_common_msg = "If you unlock the bootloader, "\
@@ -213,6 +216,7 @@ static char *str_align_right(char *str, int factor)
 /* msg_lock need to be holded when call this function. */
 void display_unlock_menu_renew(struct select_msg_info *unlock_msg_info, int type)
 {
+	fbcon_update_begin();
 	fbcon_clear();
 	memset(&unlock_msg_info->info, 0, sizeof(struct menu_info));
 
@@ -249,6 +253,8 @@ void display_unlock_menu_renew(struct select_msg_info *unlock_msg_info, int type
 
 	/* Initialize the option index */
 	unlock_msg_info->info.option_index= 2;
+
+	fbcon_update_end();
 }
 
 #if VERIFIED_BOOT
@@ -269,6 +275,7 @@ void display_bootverify_menu_renew(struct select_msg_info *msg_info, int type)
 	unsigned int i = 0;
 	uint32_t timeout = DELAY_5SEC;
 
+	fbcon_update_begin();
 	fbcon_clear();
 	memset(&msg_info->info, 0, sizeof(struct menu_info));
 
@@ -328,6 +335,8 @@ void display_bootverify_menu_renew(struct select_msg_info *msg_info, int type)
 
 	/* Initialize the time out time */
 	msg_info->info.timeout_time = timeout; //5s
+
+	fbcon_update_end();
 }
 #endif
 
@@ -337,6 +346,7 @@ void display_bootverify_option_menu_renew(struct select_msg_info *msg_info)
 	int i = 0;
 	int len = 0;
 
+	fbcon_update_begin();
 	fbcon_clear();
 	memset(&msg_info->info, 0, sizeof(struct menu_info));
 
@@ -361,6 +371,8 @@ void display_bootverify_option_menu_renew(struct select_msg_info *msg_info)
 
 	/* Initialize the option index */
 	msg_info->info.option_index= len;
+
+	fbcon_update_end();
 }
 
 static void display_fastboot_menu_print_fw_info(char *msg, size_t msg_size)
@@ -414,6 +426,7 @@ void display_fastboot_menu_renew(struct select_msg_info *fastboot_msg_info)
 	int msg_type = FBCON_COMMON_MSG;
 	char msg_buf[64];
 	char msg[128];
+	char *option;
 	uint32_t res;
 
 	/* The fastboot menu is switched base on the option index
@@ -421,10 +434,14 @@ void display_fastboot_menu_renew(struct select_msg_info *fastboot_msg_info)
 	 */
 	uint32_t option_index = fastboot_msg_info->info.option_index;
 
+	fbcon_update_begin();
 	fbcon_clear();
 	memset(&fastboot_msg_info->info, 0, sizeof(struct menu_info));
 
 	len = ARRAY_SIZE(fastboot_option_menu);
+#if WITH_LK2ND
+	len += fsboot_entry_count();
+#endif
 	switch(option_index) {
 		case 0:
 			msg_type = FBCON_GREEN_MSG;
@@ -436,10 +453,23 @@ void display_fastboot_menu_renew(struct select_msg_info *fastboot_msg_info)
 		case 3:
 			msg_type = FBCON_COMMON_MSG;
 			break;
+		default:
+			msg_type = FBCON_GREEN_MSG;
+			break;
 	}
+
+#if WITH_LK2ND
+	/* Boot entries of fs-boot follow the fixed options */
+	if (option_index >= ARRAY_SIZE(fastboot_option_menu)) {
+		snprintf(msg, sizeof(msg), "Boot %s\n", fsboot_entry_name(
+			 option_index - ARRAY_SIZE(fastboot_option_menu)));
+		option = msg;
+	} else
+#endif
+		option = fastboot_option_menu[option_index];
+
 	fbcon_draw_line(msg_type);
-	display_fbcon_menu_message(fastboot_option_menu[option_index],
-		msg_type, big_factor);
+	display_fbcon_menu_message(option, msg_type, big_factor);
 	fbcon_draw_line(msg_type);
 	display_fbcon_menu_message("\n\nPress volume keys to navigate, and "\
 		"press power key to select\n\n", FBCON_COMMON_MSG, common_factor);
@@ -497,6 +527,10 @@ void display_fastboot_menu_renew(struct select_msg_info *fastboot_msg_info)
 		snprintf(msg, sizeof(msg), "PANEL - %s\n", lk2nd_dev.panel.name);
 		display_fbcon_menu_message(msg, FBCON_COMMON_MSG, common_factor);
 	}
+#if TARGET_MSM8916
+	/* The battery is detected in the background */
+	smb1360_wait();
+#endif
 	if (lk2nd_dev.battery) {
 		unsigned int type = FBCON_COMMON_MSG;
 
@@ -544,6 +578,8 @@ void display_fastboot_menu_renew(struct select_msg_info *fastboot_msg_info)
 	fastboot_msg_info->info.msg_type = DISPLAY_MENU_FASTBOOT;
 	fastboot_msg_info->info.option_num = len;
 	fastboot_msg_info->info.option_index = option_index;
+
+	fbcon_update_end();
 }
 
 void msg_lock_init()
@@ -552,10 +588,24 @@ void msg_lock_init()
 	struct select_msg_info *msg_lock_info;
 	msg_lock_info = &msg_info;
 
+	enter_critical_section();
 	if (!is_msg_lock_init) {
 		mutex_init(&msg_lock_info->msg_lock);
 		is_msg_lock_init = true;
 	}
+	exit_critical_section();
+}
+
+/* For other threads drawing on fbcon, e.g. the log console */
+void msg_lock_acquire()
+{
+	msg_lock_init();
+	mutex_acquire(&msg_info.msg_lock);
+}
+
+void msg_lock_release()
+{
+	mutex_release(&msg_info.msg_lock);
 }
 
 static void display_menu_thread_start(struct select_msg_info *msg_info)
@@ -33,6 +33,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <debug.h>
+#include <dma.h>
 #include <platform.h>
 #include <platform/iomap.h>
 #include <platform/irqs.h>
@@ -258,8 +259,7 @@ struct udc_request *udc_request_alloc(void)
 	ASSERT(req);
 	req->req.buf = 0;
 	req->req.length = 0;
-	req->item = memalign(CACHE_LINE, ROUNDUP(sizeof(struct ept_queue_item),
-								CACHE_LINE));
+	req->item = dma_alloc_coherent(sizeof(struct ept_queue_item));
 	return &req->req;
 }
 
@@ -309,8 +309,7 @@ int udc_request_queue(struct udc_endpoint *ept, struct udc_request *_req)
 			 * Allocate new TD only if chain doesnot
 			 * exist already
 			 */
-			item = memalign(CACHE_LINE,
-					ROUNDUP(sizeof(struct ept_queue_item), CACHE_LINE));
+			item = dma_alloc_coherent(sizeof(struct ept_queue_item));
 			if (!item) {
 				dprintf(ALWAYS, "allocate USB item fail ept%d"
 							"%s queue\n",
@@ -348,14 +347,11 @@ int udc_request_queue(struct udc_endpoint *ept, struct udc_request *_req)
 	ept->head->next = PA(req->item);
 	ept->head->info = 0;
 	ept->req = req;
-	arch_clean_invalidate_cache_range((addr_t) ept,
-					  sizeof(struct udc_endpoint));
-	arch_clean_invalidate_cache_range((addr_t) ept->head,
-					  sizeof(struct ept_queue_head));
-	arch_clean_invalidate_cache_range((addr_t) ept->req,
-					  sizeof(struct usb_request));
-	arch_clean_invalidate_cache_range((addr_t) VA(req->req.buf),
-					  req->req.length);
+	dma_sync_for_device(ept, sizeof(struct udc_endpoint));
+	dma_sync_for_device(ept->head, sizeof(struct ept_queue_head));
+	dma_sync_for_device(ept->req, sizeof(struct usb_request));
+	dma_map(VA(req->req.buf), req->req.length,
+		ept->in ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
 
 	item = req->item;
 	/* Write all TD's to memory from cache */
@@ -365,8 +361,7 @@ int udc_request_queue(struct udc_endpoint *ept, struct udc_request *_req)
 			item = NULL;
 		else
 			item = curr_item->next;
-		arch_clean_invalidate_cache_range((addr_t) curr_item,
-					  sizeof(struct ept_queue_item));
+		dma_sync_for_device(curr_item, sizeof(struct ept_queue_item));
 	}
 
 	DBG("ept%d %s queue req=%p\n", ept->num, ept->in ? "in" : "out", req);
@@ -386,14 +381,12 @@ static void handle_ept_complete(struct udc_endpoint *ept)
 	DBG("ept%d %s complete req=%p\n",
 	    ept->num, ept->in ? "in" : "out", ept->req);
 
-	arch_invalidate_cache_range((addr_t) ept,
-					  sizeof(struct udc_endpoint));
+	dma_sync_for_cpu(ept, sizeof(struct udc_endpoint));
 
 	if(ept->req)
 	{
 		req = VA(ept->req);
-		arch_invalidate_cache_range((addr_t) ept->req,
-						sizeof(struct usb_request));
+		dma_sync_for_cpu(ept->req, sizeof(struct usb_request));
 	}
 
 	if (req) {
@@ -410,9 +403,8 @@ static void handle_ept_complete(struct udc_endpoint *ept)
 				 * data before checking the status
 				 * every time.
 				 */
-				arch_invalidate_cache_range((addr_t)(item),
-							sizeof(
-							struct ept_queue_item));
+				dma_sync_for_cpu(item,
+						 sizeof(struct ept_queue_item));
 
 			} while(readl(&item->info) & INFO_ACTIVE);
 
@@ -30,6 +30,8 @@
 #ifndef __BOOT_STATS_H
 #define __BOOT_STATS_H
 
+#include <sys/types.h>
+
 /* The order of the entries in this enum does not correspond to bootup order.
  * It is mandated by the expected order of the entries in imem when the values
  * are read in the kernel.
@@ -44,5 +46,6 @@ enum bs_entry {
 	BS_MAX,
 };
 void bs_set_timestamp(enum bs_entry bs_id);
+uint32_t bs_get_timestamp(enum bs_entry bs_id);
 
 #endif
@@ -85,6 +85,9 @@ typedef struct {
 	unsigned int auth_iv[8];
 } crypto_SHA256_ctx;
 
+void hash_find(unsigned char *addr, unsigned int size, unsigned char *digest,
+	       unsigned char auth_alg);
+
 extern void crypto_eng_reset(void);
 
 extern void crypto_eng_init(void);
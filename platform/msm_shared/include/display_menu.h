@@ -75,5 +75,7 @@ void display_bootverify_menu(int type);
 void display_fastboot_menu();
 void display_unlock_menu(int type);
 void msg_lock_init();
+void msg_lock_acquire();
+void msg_lock_release();
 void exit_menu_keys_detection();
 #endif				/* __PLATFORM_MSM_SHARED_DISPLAY_MENU_H */
@@ -88,9 +88,12 @@
 
 #define MDP_HW_REV                              REG_MDP(0x0100)
 #define MDP_INTR_EN                             REG_MDP(0x0110)
+#define MDP_INTR_STATUS                         REG_MDP(0x0114)
 #define MDP_INTR_CLEAR                          REG_MDP(0x0118)
 #define MDP_HIST_INTR_EN                        REG_MDP(0x011C)
 
+#define MDP_INTR_INTF_1_VSYNC                   BIT(27)
+
 #define MDP_DISP_INTF_SEL                       REG_MDP(0x0104)
 #define MDP_VIDEO_INTF_UNDERFLOW_CTL            REG_MDP(0x03E0)
 #define MDP_UPPER_NEW_ROI_PRIOR_RO_START        REG_MDP(0x02EC)
@@ -103,6 +103,7 @@
 #define MMC_USR_WP                                171
 #define MMC_ERASE_TIMEOUT_MULT                    223
 #define MMC_HC_ERASE_GRP_SIZE                     224
+#define MMC_MAX_PACKED_WRITES                     500
 #define MMC_PARTITION_CONFIG                      179
 #define MMC_EXT_CSD_EN_RPMB_REL_WR                166 //emmc 5.1 and above
 
@@ -120,6 +121,7 @@
 #define MMC_SEC_COUNT2_SHIFT                      8
 #define MMC_HC_ERASE_MULT                         (512 * 1024)
 #define RST_N_FUNC_ENABLE                         BIT(0)
+#define MMC_EXT_CSD_REV_4_5                       6
 
 /* RPMB Related */
 #define RPMB_PART_MIN_SIZE                        (128 * 2014)
@@ -128,6 +130,12 @@
 #define PARTITION_ACCESS_MASK                     0x7
 #define MAX_RPMB_CMDS                             0x3
 
+/* Packed commands */
+#define MMC_PACKED_CMD_VER                        0x01
+#define MMC_PACKED_CMD_WR                         0x02
+#define MMC_PACKED_HDR_SZ                         512
+#define MMC_PACKED_MAX_ENTRIES                    ((MMC_PACKED_HDR_SZ / 8) - 1)
+
 /* Command related */
 #define MMC_MAX_COMMAND_RETRY                     1000
 #define MMC_MAX_CARD_STAT_RETRY                   10000
@@ -182,7 +190,9 @@
 #define MMC_SD_SWITCH_HS                          0x80FFFFF1
 
 #define SD_CMD8_MAX_RETRY                         0x3
-#define SD_ACMD41_MAX_RETRY                       0x14
+/* As per SDCC spec try for max 1 second, polling every 5 ms */
+#define SD_ACMD41_TIMEOUT_US                      1000000
+#define SD_ACMD41_POLL_US                         5000
 
 /* SCR(SD Card Register) related */
 #define SD_SCR_BUS_WIDTH                          16
@@ -311,6 +321,7 @@ struct mmc_card {
 	uint32_t raw_scr[2];     /* SCR for SD card */
 	uint32_t rpmb_size;      /* Size of rpmb partition */
 	uint32_t rel_wr_count;   /* Reliable write count */
+	uint32_t max_packed_writes; /* Max entries in a packed write, 0 if unsupported */
 	struct mmc_cid cid;      /* CID structure */
 	struct mmc_csd csd;      /* CSD structure */
 	struct mmc_sd_scr scr;   /* SCR structure */
@@ -334,6 +345,13 @@ struct mmc_device {
 	struct sdhci_host host;          /* Handle to host controller */
 	struct mmc_card card;            /* Handle to mmc card */
 	struct mmc_config_data config;   /* Handle for the mmc config data */
+	uint32_t clk_step;               /* Clock step for bus error fallback */
+};
+
+/* Block range to be read by mmc_sdhci_prefetch() */
+struct mmc_prefetch_range {
+	uint64_t blk_addr;
+	uint32_t num_blocks;
 };
 
 /*
@@ -341,10 +359,17 @@ struct mmc_device {
  */
 /* API: Initialize the mmc card */
 struct mmc_device *mmc_init(struct mmc_config_data *);
+/* API: Initialize a device from mmc_init again, e.g. for a new card */
+struct mmc_device *mmc_reinit(struct mmc_device *dev);
 /* API: Read required number of blocks from card into destination */
 uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest, uint64_t blk_addr, uint32_t num_blocks);
 /* API: Write requried number of blocks from source to card */
 uint32_t mmc_sdhci_write(struct mmc_device *dev, void *src, uint64_t blk_addr, uint32_t num_blocks);
+/* API: Read/Write consecutive blocks from/to scattered buffers in one command */
+uint32_t mmc_sdhci_readv(struct mmc_device *dev, struct mmc_data_seg *segs, uint32_t num_segs, uint64_t blk_addr);
+uint32_t mmc_sdhci_writev(struct mmc_device *dev, struct mmc_data_seg *segs, uint32_t num_segs, uint64_t blk_addr);
+/* API: Write scattered block ranges using a single packed write command */
+uint32_t mmc_sdhci_packed_write(struct mmc_device *dev, struct mmc_data_seg *segs, uint64_t *blk_addrs, uint32_t count);
 /* API: Erase len bytes (after converting to number of erase groups), from specified address */
 uint32_t mmc_sdhci_erase(struct mmc_device *dev, uint32_t blk_addr, uint64_t len);
 /* API: Write protect or release len bytes (after converting to number of write protect groups) from specified start address*/
@@ -357,4 +382,8 @@ void mmc_put_card_to_sleep(struct mmc_device *dev);
 bool mmc_set_drv_type(struct sdhci_host *host, struct mmc_card *card, uint8_t drv_type);
 /* API: Send the read & write command sequence to rpmb */
 uint32_t mmc_sdhci_rpmb_send(struct mmc_device *dev, struct mmc_command *cmd);
+/* API: Read scattered blocks in one sorted batch to serve later reads from memory */
+uint32_t mmc_sdhci_prefetch(struct mmc_device *dev, struct mmc_prefetch_range *ranges, uint32_t count);
+/* API: Free the blocks read by mmc_sdhci_prefetch() */
+void mmc_sdhci_prefetch_drop(struct mmc_device *dev);
 #endif
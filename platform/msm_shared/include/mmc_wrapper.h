@@ -32,13 +32,32 @@
 #include <mmc_sdhci.h>
 
 #define BOARD_KERNEL_PAGESIZE                2048
+
+/* Queue for batching many small writes, see mmc_write_queued() */
+#define MMC_WRITE_QUEUE_MAX_ENTRIES          32
+#define MMC_WRITE_QUEUE_MAX_BYTES            (1024 * 1024)
+
+struct mmc_write_queue {
+	uint32_t count;
+	uint32_t bytes;
+	uint64_t data_addr[MMC_WRITE_QUEUE_MAX_ENTRIES];
+	struct mmc_data_seg segs[MMC_WRITE_QUEUE_MAX_ENTRIES];
+};
+
 /* Wrapper APIs */
 
 struct mmc_device *get_mmc_device();
 uint32_t mmc_get_psn(void);
+uint32_t mmc_get_cid_serial(void);
 
 uint32_t mmc_read(uint64_t data_addr, uint32_t *out, uint32_t data_len);
+uint32_t mmc_prefetch(struct mmc_prefetch_range *ranges, uint32_t count);
+void mmc_get_read_stats(uint64_t *bytes, uint64_t *us);
+void mmc_prefetch_drop(void);
 uint32_t mmc_write(uint64_t data_addr, uint32_t data_len, void *in);
+void mmc_write_queue_init(struct mmc_write_queue *queue);
+uint32_t mmc_write_queued(struct mmc_write_queue *queue, uint64_t data_addr, uint32_t data_len, void *in);
+uint32_t mmc_write_queue_flush(struct mmc_write_queue *queue);
 uint32_t mmc_erase_card(uint64_t, uint64_t);
 uint64_t mmc_get_device_capacity(void);
 uint32_t mmc_erase_card(uint64_t addr, uint64_t len);
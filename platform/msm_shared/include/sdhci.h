@@ -48,6 +48,7 @@
  */
 struct host_caps {
 	uint32_t base_clk_rate;  /* Max clock rate supported */
+	uint32_t timeout_clk_rate; /* Data timeout clock in KHz */
 	uint32_t max_blk_len;    /* Max block len supported */
 	uint8_t bus_width_8bit;  /* 8 Bit mode supported */
 	uint8_t adma_support;    /* Adma support */
@@ -67,6 +68,8 @@ struct sdhci_host {
 	uint32_t base;           /* Base address for the host */
 	uint32_t cur_clk_rate;   /* Running clock rate */
 	uint32_t timing;         /* current timing for the host */
+	uint8_t data_timeout;    /* Data timeout counter value */
+	uint32_t last_err;       /* Error status of the last failed command */
 	bool tuning_in_progress; /* Tuning is being executed */
 	uint8_t major;           /* host controller minor ver */
 	uint16_t minor;          /* host controller major ver */
@@ -76,6 +79,14 @@ struct sdhci_host {
 	struct sdhci_msm_data *msm_host; /* MSM specific host info */
 };
 
+/*
+ * One segment of a scattered data buffer
+ */
+struct mmc_data_seg {
+	void *data_ptr;      /* Start of the segment */
+	uint32_t len;        /* Length in bytes, multiple of SDHCI_MMC_BLK_SZ */
+};
+
 /*
  * Data pointer to be read/written
  */
@@ -83,6 +94,8 @@ struct mmc_data {
 	void *data_ptr;      /* Points to stream of data */
 	uint32_t blk_sz;     /* Block size for the data */
 	uint32_t num_blocks; /* num of blocks, each always of size SDHCI_MMC_BLK_SZ */
+	struct mmc_data_seg *segs; /* Scatter list, used instead of data_ptr if set */
+	uint32_t num_segs;   /* Number of entries in segs */
 };
 
 /*
@@ -102,6 +115,7 @@ struct mmc_command {
 	bool write_flag;        /* Write flag, for reliable write cases */
 	struct mmc_data data;   /* Data pointer */
 	uint8_t rel_write;      /* Reliable write enable flag */
+	uint8_t packed;         /* Packed command, data starts with the packed header */
 };
 
 /*
@@ -217,6 +231,8 @@ enum {
 #define SDHCI_CLK_DIS                             (0 << 2)
 #define SDHCI_CLK_RATE_MASK                       0x0000FF00
 #define SDHCI_CLK_RATE_BIT                        8
+#define SDHCI_TIMEOUT_CLK_MASK                    0x0000003F
+#define SDHCI_TIMEOUT_CLK_UNIT_MHZ                BIT(7)
 
 #define SDHCI_CMD_ACT                             BIT(0)
 #define SDHCI_DAT_ACT                             BIT(1)
@@ -254,6 +270,7 @@ enum {
 #define SDHCI_ERR_INT_STAT_MASK                   0x8000
 #define SDHCI_ADMA_DESC_LINE_SZ                   65536
 #define SDHCI_ADMA_MAX_TRANS_SZ                   (65535 * 512)
+#define SDHCI_CMD23_PACKED                        BIT(30)
 #define SDHCI_ADMA_TRANS_VALID                    BIT(0)
 #define SDHCI_ADMA_TRANS_END                      BIT(1)
 #define SDHCI_ADMA_TRANS_DATA                     BIT(5)
@@ -290,6 +307,11 @@ enum {
 #define SDHCI_READ_MODE                           BIT(4)
 #define SDHCI_SWITCH_CMD                          6
 #define SDHCI_CMD_TIMEOUT                         0xF
+/* Data timeout is 2^(13 + n) timeout clock cycles, n <= 14 */
+#define SDHCI_DATA_TIMEOUT_SHIFT                  13
+#define SDHCI_DATA_TIMEOUT_MAX                    0xE
+#define SDHCI_BUS_ERR_MASK                        (SDHCI_CMD_CRC_MASK | SDHCI_CMD_END_BIT_MASK | \
+                                                   SDHCI_DAT_CRC_MASK | SDHCI_DAT_END_BIT_MASK)
 #define SDHCI_MAX_CMD_RETRY                       9000000
 #define SDHCI_MAX_TRANS_RETRY                     10000000
 
@@ -375,6 +397,10 @@ uint32_t sdhci_send_command(struct sdhci_host *, struct mmc_command *);
 uint8_t  sdhci_set_bus_width(struct sdhci_host *, uint16_t);
 /* API: Clock supply for the controller */
 uint32_t sdhci_clk_supply(struct sdhci_host *, uint32_t);
+/* API: Change the clock of a running card */
+uint32_t sdhci_change_freq_clk(struct sdhci_host *, uint32_t);
+/* API: Set the data timeout, returns the timeout actually used in us */
+uint32_t sdhci_set_data_timeout(struct sdhci_host *, uint32_t);
 /* API: To enable SDR/DDR mode */
 void sdhci_set_uhs_mode(struct sdhci_host *, uint32_t);
 /* API: Soft reset for the controller */
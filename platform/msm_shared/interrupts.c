@@ -34,7 +34,14 @@
 
 extern int target_supports_qgic();
 
+#if LK2ND_PROFILE
+/* Interrupted context, so the lk2nd profiler can sample the PC from a timer */
+struct arm_iframe *platform_irq_frame;
+
+static enum handler_return platform_irq_dispatch(struct arm_iframe *frame)
+#else
 enum handler_return platform_irq(struct arm_iframe *frame)
+#endif
 {
 #if TARGET_USES_GIC_VIC
 	if(target_supports_qgic())
@@ -46,6 +53,19 @@ enum handler_return platform_irq(struct arm_iframe *frame)
 #endif
 }
 
+#if LK2ND_PROFILE
+enum handler_return platform_irq(struct arm_iframe *frame)
+{
+	enum handler_return ret;
+
+	platform_irq_frame = frame;
+	ret = platform_irq_dispatch(frame);
+	platform_irq_frame = NULL;
+
+	return ret;
+}
+#endif
+
 void platform_fiq(struct arm_iframe *frame)
 {
 #if TARGET_USES_GIC_VIC
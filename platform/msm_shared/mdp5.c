@@ -959,13 +959,24 @@ int mdp_dsi_video_on(struct msm_panel_info *pinfo)
 	return NO_ERROR;
 }
 
+static bool mdp_intf_1_vsync(void *arg)
+{
+	return readl(MDP_INTR_STATUS) & MDP_INTR_INTF_1_VSYNC;
+}
+
 int mdp_dsi_video_off()
 {
 	if(!target_cont_splash_screen())
 	{
+		/*
+		 * The timing engine stops at the end of the current frame,
+		 * wait for its VSYNC (but at most 60 ms, a frame at ~17 Hz).
+		 */
+		writel(MDP_INTR_INTF_1_VSYNC, MDP_INTR_CLEAR);
 		writel(0x00000000, MDP_INTF_1_TIMING_ENGINE_EN +
 				mdss_mdp_intf_offset());
-		mdelay(60);
+		wait_for_cond("mdp intf1 vsync", mdp_intf_1_vsync, NULL,
+			      60000, 100);
 		/* Ping-Pong done Tear Check Read/Write  */
 		/* Underrun(Interface 0/1/2/3) VSYNC Interrupt Enable  */
 		writel(0xFF777713, MDP_INTR_CLEAR);
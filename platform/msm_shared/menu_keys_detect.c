@@ -38,6 +38,7 @@
 #include <dev/fbcon.h>
 #include <menu_keys_detect.h>
 #include <display_menu.h>
+#include <fs_boot.h>
 #include <platform/gpio.h>
 #include <platform/iomap.h>
 #include <platform.h>
@@ -164,6 +165,7 @@ static void update_device_status(struct select_msg_info* msg_info, int reason)
 /* msg_lock need to be holded when call this function. */
 static void update_volume_up_bg(struct select_msg_info* msg_info)
 {
+	fbcon_update_begin();
 	if (msg_info->info.option_index == msg_info->info.option_num - 1) {
 		fbcon_draw_msg_background(msg_info->info.option_start[0],
 			msg_info->info.option_end[0],
@@ -181,11 +183,13 @@ static void update_volume_up_bg(struct select_msg_info* msg_info)
 			msg_info->info.option_end[msg_info->info.option_index + 1],
 			msg_info->info.option_bg[msg_info->info.option_index + 1], 0);
 	}
+	fbcon_update_end();
 }
 
 /* msg_lock need to be holded when call this function. */
 static void update_volume_down_bg(struct select_msg_info* msg_info)
 {
+	fbcon_update_begin();
 	if (msg_info->info.option_index == 0) {
 		fbcon_draw_msg_background(msg_info->info.option_start[0],
 			msg_info->info.option_end[0],
@@ -203,6 +207,7 @@ static void update_volume_down_bg(struct select_msg_info* msg_info)
 			msg_info->info.option_end[msg_info->info.option_index - 1],
 			msg_info->info.option_bg[msg_info->info.option_index - 1], 0);
 	}
+	fbcon_update_end();
 }
 
 /* update select option's background when volume up key is pressed */
@@ -269,6 +274,12 @@ static void power_key_func(struct select_msg_info* msg_info)
 		case DISPLAY_MENU_FASTBOOT:
 			if(msg_info->info.option_index < ARRAY_SIZE(fastboot_index_action))
 				reason = fastboot_index_action[msg_info->info.option_index];
+#if WITH_LK2ND
+			/* fs-boot entry: pick it for the next boot and restart */
+			else if (!fsboot_select_entry(msg_info->info.option_index -
+						      ARRAY_SIZE(fastboot_index_action)))
+				reason = RESTART;
+#endif
 			break;
 		default:
 			dprintf(CRITICAL,"Unsupported menu type\n");
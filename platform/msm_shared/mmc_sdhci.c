@@ -30,11 +30,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <debug.h>
+#include <dma.h>
 #include <reg.h>
 #include <mmc_sdhci.h>
 #include <sdhci.h>
 #include <sdhci_msm.h>
 #include <partition_parser.h>
+#include <platform.h>
 #include <platform/iomap.h>
 #include <platform/timer.h>
 
@@ -252,6 +254,10 @@ static uint32_t mmc_decode_and_save_csd(struct mmc_card *card)
 
 		card->rpmb_size = RPMB_PART_MIN_SIZE * card->ext_csd[RPMB_SIZE_MULT];
 		card->rel_wr_count = card->ext_csd[REL_WR_SEC_C];
+
+		/* Packed commands were introduced with eMMC 4.5 */
+		if (card->ext_csd[MMC_EXT_CSD_REV] >= MMC_EXT_CSD_REV_4_5)
+			card->max_packed_writes = MIN(card->ext_csd[MMC_MAX_PACKED_WRITES], MMC_PACKED_MAX_ENTRIES);
 	}
 	else {
 		card->wp_grp_size = (card->csd.wp_grp_size + 1) * (card->csd.erase_grp_size + 1) \
@@ -1102,7 +1108,10 @@ static uint8_t mmc_host_init(struct mmc_device *dev)
 	host->sdhc_event = &sdhc_event;
 	host->caps.hs400_support = cfg->hs400_support;
 
-	data = (struct sdhci_msm_data *) malloc(sizeof(struct sdhci_msm_data));
+	/* Keep the msm data of a re-initialized host, the pwr irq refers to it */
+	data = host->msm_host;
+	if (!data)
+		data = (struct sdhci_msm_data *) malloc(sizeof(struct sdhci_msm_data));
 	ASSERT(data);
 
 	data->sdhc_event = &sdhc_event;
@@ -1242,11 +1251,64 @@ static uint32_t mmc_send_app_cmd(struct sdhci_host *host, struct mmc_card *card)
 	return 0;
 }
 
+struct mmc_sd_acmd41 {
+	struct sdhci_host *host;
+	struct mmc_card *card;
+	uint32_t err;
+};
+
+/*
+ * Function: mmc sd acmd41 ready
+ * Arg     : struct mmc_sd_acmd41
+ * Return  : true once the card is ready or a command failed
+ * Flow    : Send APP_CMD + ACMD41 and check the busy bit in the OCR
+ */
+static bool mmc_sd_acmd41_ready(void *arg)
+{
+	struct mmc_sd_acmd41 *acmd41 = arg;
+	struct mmc_card *card = acmd41->card;
+	struct mmc_command cmd;
+
+	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
+
+	/* Send APP_CMD before ACMD41*/
+	if (mmc_send_app_cmd(acmd41->host, card))
+	{
+		dprintf(CRITICAL, "Failed sending App command\n");
+		acmd41->err = 1;
+		return true;
+	}
+
+	/* APP_CMD is successful, send ACMD41 now */
+	cmd.cmd_index = ACMD41_SEND_OP_COND;
+	cmd.argument = MMC_SD_OCR | MMC_SD_HC_HCS;
+	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+	cmd.resp_type = SDHCI_CMD_RESP_R3;
+
+	if (sdhci_send_command(acmd41->host, &cmd))
+	{
+		dprintf(CRITICAL, "Failure sending ACMD41\n");
+		acmd41->err = 1;
+		return true;
+	}
+
+	if (!(cmd.resp[0] & MMC_SD_DEV_READY))
+		return false;
+
+	if (cmd.resp[0] & (1 << 30))
+		card->type = MMC_CARD_TYPE_SDHC;
+	else
+		card->type = MMC_CARD_TYPE_STD_SD;
+
+	return true;
+}
+
 uint32_t mmc_sd_card_init(struct sdhci_host *host, struct mmc_card *card)
 {
 	uint8_t i;
 	uint32_t mmc_ret;
 	struct mmc_command cmd;
+	struct mmc_sd_acmd41 acmd41;
 
 	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
 
@@ -1285,50 +1347,20 @@ uint32_t mmc_sd_card_init(struct sdhci_host *host, struct mmc_card *card)
 	}
 
 	/* Send ACMD41 for OCR */
-	for (i = 0; i < SD_ACMD41_MAX_RETRY; i++)
-	{
-		/* Send APP_CMD before ACMD41*/
-		if (mmc_send_app_cmd(host, card))
-		{
-			dprintf(CRITICAL, "Failed sending App command\n");
-			return 1;
-		}
-
-		/* APP_CMD is successful, send ACMD41 now */
-		cmd.cmd_index = ACMD41_SEND_OP_COND;
-		cmd.argument = MMC_SD_OCR | MMC_SD_HC_HCS;
-		cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
-		cmd.resp_type = SDHCI_CMD_RESP_R3;
-
-		if (sdhci_send_command(host, &cmd))
-		{
-			dprintf(CRITICAL, "Failure sending ACMD41\n");
-			return 1;
-		}
-		else
-		{
-			if (cmd.resp[0] & MMC_SD_DEV_READY)
-			{
-				if (cmd.resp[0] & (1 << 30))
-					card->type = MMC_CARD_TYPE_SDHC;
-				else
-					card->type = MMC_CARD_TYPE_STD_SD;
-
-				break;
-			}
-		}
-		/*
-		 * As per SDCC spec try for max 1 second
-		 */
-		mdelay(50);
-	}
+	acmd41.host = host;
+	acmd41.card = card;
+	acmd41.err = 0;
 
-	if (i == SD_ACMD41_MAX_RETRY && !(cmd.resp[0] & MMC_SD_DEV_READY))
+	if (wait_for_cond("sd acmd41", mmc_sd_acmd41_ready, &acmd41,
+			  SD_ACMD41_TIMEOUT_US, SD_ACMD41_POLL_US))
 	{
 		dprintf(CRITICAL, "Error: ACMD41 response timed out\n");
 		return 1;
 	}
 
+	if (acmd41.err)
+		return 1;
+
 	return 0;
 }
 
@@ -1475,6 +1507,9 @@ uint32_t mmc_sd_set_hs(struct sdhci_host *host, struct mmc_card *card)
        if (sdhci_send_command(host, &cmd))
              return 1;
 
+	/* Save the timing value, before changing the clock */
+	MMC_SAVE_TIMING(host, SDHCI_SDR25_MODE);
+
 	/* Set the SDR25 mode in controller*/
 	sdhci_set_uhs_mode(host, SDHCI_SDR25_MODE);
 
@@ -1702,6 +1737,8 @@ static uint32_t mmc_card_init(struct mmc_device *dev)
 	return mmc_return;
 }
 
+static void mmc_tune_bus(struct mmc_device *dev);
+
 /*
  * Function: mmc display csd
  * Arg     : None
@@ -1741,8 +1778,8 @@ static ssize_t mmc_sdhci_bdev_read_block(struct bdev *_bdev, void *buf, bnum_t b
 	 * but callers to this routine normally provide
 	 * write back buffers. Invalidate cache
 	 * before read data from mmc.
-         */
-	arch_clean_invalidate_cache_range((addr_t)(sptr), data_len);
+	 */
+	dma_map(sptr, data_len, DMA_FROM_DEVICE);
 
 	while (data_len > read_size) {
 		ret = mmc_sdhci_read(bdev->mmcdev, (void *)sptr, (data_addr / block_size), (read_size / block_size));
@@ -1778,7 +1815,7 @@ static ssize_t mmc_sdhci_bdev_write_block(struct bdev *_bdev, const void *buf, b
 	 * Flush the cache before handing over the data to
 	 * storage driver
 	 */
-	arch_clean_invalidate_cache_range((addr_t)sptr, data_len);
+	dma_map(sptr, data_len, DMA_TO_DEVICE);
 
 	while (data_len > write_size) {
 		val = mmc_sdhci_write(bdev->mmcdev, (void *)sptr, (data_addr / block_size), (write_size / block_size));
@@ -1798,32 +1835,81 @@ static ssize_t mmc_sdhci_bdev_write_block(struct bdev *_bdev, const void *buf, b
 	else
 		return count * block_size;
 }
+
+static ssize_t mmc_sdhci_bdev_xfer_blockv(struct bdev *_bdev, const bio_vec_t *vec,
+					   uint vec_count, bnum_t block, bool write)
+{
+	mmc_sdhci_bdev_t *bdev = (mmc_sdhci_bdev_t *)_bdev;
+
+	struct mmc_data_seg *segs;
+	uint32_t block_size = bdev->dev.block_size;
+	size_t data_len = 0;
+	ssize_t ret;
+	uint i;
+
+	for (i = 0; i < vec_count; i++)
+		data_len += vec[i].len;
+
+	/* Split up transfers that do not fit in one adma descriptor table */
+	if (data_len > SDHCI_ADMA_MAX_TRANS_SZ || block_size != SDHCI_MMC_BLK_SZ) {
+		for (i = 0; i < vec_count; i++) {
+			if (write)
+				ret = mmc_sdhci_bdev_write_block(_bdev, vec[i].buf, block, vec[i].len / block_size);
+			else
+				ret = mmc_sdhci_bdev_read_block(_bdev, vec[i].buf, block, vec[i].len / block_size);
+			if (ret < 0)
+				return ret;
+			block += vec[i].len / block_size;
+		}
+		return data_len;
+	}
+
+	segs = malloc(vec_count * sizeof(*segs));
+	if (!segs)
+		return ERR_NO_MEMORY;
+
+	for (i = 0; i < vec_count; i++) {
+		segs[i].data_ptr = vec[i].buf;
+		segs[i].len = vec[i].len;
+		dma_map(vec[i].buf, vec[i].len, write ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+	}
+
+	if (write)
+		ret = mmc_sdhci_writev(bdev->mmcdev, segs, vec_count, block);
+	else
+		ret = mmc_sdhci_readv(bdev->mmcdev, segs, vec_count, block);
+
+	free(segs);
+
+	if (ret)
+		return ERR_IO;
+	else
+		return data_len;
+}
+
+static ssize_t mmc_sdhci_bdev_read_blockv(struct bdev *bdev, const bio_vec_t *vec, uint vec_count, bnum_t block)
+{
+	return mmc_sdhci_bdev_xfer_blockv(bdev, vec, vec_count, block, false);
+}
+
+static ssize_t mmc_sdhci_bdev_write_blockv(struct bdev *bdev, const bio_vec_t *vec, uint vec_count, bnum_t block)
+{
+	return mmc_sdhci_bdev_xfer_blockv(bdev, vec, vec_count, block, true);
+}
 #endif
 
 /*
- * Function: mmc_init
- * Arg     : MMC configuration data
- * Return  : Pointer to mmc device
- * Flow    : Entry point to MMC boot process
- *           Initialize the sd host controller
+ * Function: mmc_init_dev
+ * Arg     : Pointer to mmc device with the config filled in
+ * Return  : Pointer to mmc device, NULL on failure
+ * Flow    : Initialize the sd host controller
  *           Initialize the mmc card
  *           Set the clock & high speed mode
+ *           Register the block device
  */
-struct mmc_device *mmc_init(struct mmc_config_data *data)
+static struct mmc_device *mmc_init_dev(struct mmc_device *dev)
 {
 	uint8_t mmc_ret = 0;
-	struct mmc_device *dev;
-
-	dev = (struct mmc_device *) malloc (sizeof(struct mmc_device));
-
-	if (!dev) {
-		dprintf(CRITICAL, "Error allocating mmc device\n");
-		return NULL;
-	}
-
-	ASSERT(data);
-
-	memcpy((void*)&dev->config, (void*)data, sizeof(struct mmc_config_data));
 
 	memset((struct mmc_card *)&dev->card, 0, sizeof(struct mmc_card));
 
@@ -1846,12 +1932,14 @@ struct mmc_device *mmc_init(struct mmc_config_data *data)
 
 	dprintf(INFO, "Done initialization of the card\n");
 
+	mmc_tune_bus(dev);
+
 	mmc_display_csd(&dev->card);
 
 #if WITH_LIB_BIO
 	char name[20];
 	mmc_sdhci_bdev_t *bdev = malloc(sizeof(mmc_sdhci_bdev_t));
-	snprintf(name, sizeof(name), "hd%d", data->slot);
+	snprintf(name, sizeof(name), "hd%d", dev->config.slot);
 
 	/* set up the base device */
 	bio_initialize_bdev(&bdev->dev, name, dev->card.block_size, dev->card.capacity / dev->card.block_size);
@@ -1860,6 +1948,8 @@ struct mmc_device *mmc_init(struct mmc_config_data *data)
 	bdev->mmcdev = dev;
 	bdev->dev.read_block = mmc_sdhci_bdev_read_block;
 	bdev->dev.write_block = mmc_sdhci_bdev_write_block;
+	bdev->dev.read_blockv = mmc_sdhci_bdev_read_blockv;
+	bdev->dev.write_blockv = mmc_sdhci_bdev_write_blockv;
 
 	/* register it */
 	bio_register_device(&bdev->dev);
@@ -1872,6 +1962,51 @@ struct mmc_device *mmc_init(struct mmc_config_data *data)
 	return dev;
 }
 
+/*
+ * Function: mmc_init
+ * Arg     : MMC configuration data
+ * Return  : Pointer to mmc device
+ * Flow    : Entry point to MMC boot process
+ *           Allocate the mmc device & initialize it
+ */
+struct mmc_device *mmc_init(struct mmc_config_data *data)
+{
+	struct mmc_device *dev;
+
+	dev = (struct mmc_device *) malloc (sizeof(struct mmc_device));
+
+	if (!dev) {
+		dprintf(CRITICAL, "Error allocating mmc device\n");
+		return NULL;
+	}
+
+	ASSERT(data);
+
+	memset((struct sdhci_host *)&dev->host, 0, sizeof(struct sdhci_host));
+
+	memcpy((void*)&dev->config, (void*)data, sizeof(struct mmc_config_data));
+
+	return mmc_init_dev(dev);
+}
+
+/*
+ * Function: mmc_reinit
+ * Arg     : Pointer to mmc device returned by mmc_init before
+ * Return  : Pointer to mmc device, NULL on failure
+ * Flow    : Initialize the host & card again, e.g. after a removable
+ *           card was replaced. The block device must have been
+ *           unregistered. The device and its host data are reused.
+ */
+struct mmc_device *mmc_reinit(struct mmc_device *dev)
+{
+	ASSERT(dev);
+
+	/* Blocks prefetched from the old card must not match the new one */
+	mmc_sdhci_prefetch_drop(dev);
+
+	return mmc_init_dev(dev);
+}
+
 static uint32_t mmc_parse_response(uint32_t resp)
 {
 	/* Trying to write beyond card capacity */
@@ -1945,27 +2080,343 @@ static uint32_t mmc_stop_command(struct mmc_device *dev)
 }
 
 /*
- * Function: mmc sdhci read
- * Arg     : mmc device structure, block address, number of blocks & destination
+ * Small read cache for the scattered metadata blocks read during boot.
+ * It is filled once by mmc_sdhci_prefetch() and dropped on the first write.
+ */
+#define MMC_PREFETCH_MAX_SEGS	16
+#define MMC_PREFETCH_MAX_BLOCKS	128
+/* Read small gaps between ranges instead of sending another command */
+#define MMC_PREFETCH_MAX_GAP	8
+
+struct mmc_prefetch_seg {
+	uint64_t blk_addr;
+	uint32_t num_blocks;
+	uint8_t *data;
+};
+
+static struct mmc_device *prefetch_dev;
+static struct mmc_prefetch_seg prefetch_segs[MMC_PREFETCH_MAX_SEGS];
+static uint32_t prefetch_seg_count;
+static uint8_t *prefetch_buf;
+
+/*
+ * Function: mmc sdhci prefetch drop
+ * Arg     : mmc device structure
+ * Return  : None
+ * Flow    : Free the prefetched blocks if they belong to the device
+ */
+void mmc_sdhci_prefetch_drop(struct mmc_device *dev)
+{
+	if (!prefetch_dev || prefetch_dev != dev)
+		return;
+
+	prefetch_dev = NULL;
+	prefetch_seg_count = 0;
+	free(prefetch_buf);
+	prefetch_buf = NULL;
+}
+
+static bool mmc_prefetch_lookup(struct mmc_device *dev, void *dest,
+				uint64_t blk_addr, uint32_t num_blocks)
+{
+	struct mmc_prefetch_seg *seg;
+	uint32_t i;
+
+	if (prefetch_dev != dev)
+		return false;
+
+	for (i = 0; i < prefetch_seg_count; i++) {
+		seg = &prefetch_segs[i];
+		if (blk_addr < seg->blk_addr ||
+		    blk_addr + num_blocks > seg->blk_addr + seg->num_blocks)
+			continue;
+
+		memcpy(dest, seg->data + (blk_addr - seg->blk_addr) * dev->card.block_size,
+		       num_blocks * dev->card.block_size);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Function: mmc sdhci prefetch
+ * Arg     : mmc device structure, block ranges & number of ranges
+ * Return  : 0 on Success, non zero on failure
+ * Flow    : Sort the ranges (in place) and merge neighbouring ones,
+ *           read them in ascending order into a small cache that
+ *           serves later calls to mmc_sdhci_read().
+ */
+uint32_t mmc_sdhci_prefetch(struct mmc_device *dev,
+			    struct mmc_prefetch_range *ranges, uint32_t count)
+{
+	struct mmc_prefetch_range tmp;
+	struct mmc_prefetch_seg *seg = NULL;
+	uint32_t i, j, total = 0;
+	uint64_t end;
+	uint8_t *data;
+
+	mmc_sdhci_prefetch_drop(prefetch_dev);
+
+	for (i = 1; i < count; i++) {
+		tmp = ranges[i];
+		for (j = i; j > 0 && ranges[j - 1].blk_addr > tmp.blk_addr; j--)
+			ranges[j] = ranges[j - 1];
+		ranges[j] = tmp;
+	}
+
+	prefetch_seg_count = 0;
+	for (i = 0; i < count; i++) {
+		if (!ranges[i].num_blocks)
+			continue;
+
+		end = ranges[i].blk_addr + ranges[i].num_blocks;
+		if (seg && ranges[i].blk_addr <= seg->blk_addr + seg->num_blocks + MMC_PREFETCH_MAX_GAP) {
+			if (end > seg->blk_addr + seg->num_blocks) {
+				total += end - (seg->blk_addr + seg->num_blocks);
+				seg->num_blocks = end - seg->blk_addr;
+			}
+			continue;
+		}
+
+		if (prefetch_seg_count == MMC_PREFETCH_MAX_SEGS)
+			break;
+
+		seg = &prefetch_segs[prefetch_seg_count++];
+		seg->blk_addr = ranges[i].blk_addr;
+		seg->num_blocks = ranges[i].num_blocks;
+		total += seg->num_blocks;
+	}
+
+	/* Keep the cache small, later ranges will just be read as usual */
+	while (total > MMC_PREFETCH_MAX_BLOCKS) {
+		seg = &prefetch_segs[--prefetch_seg_count];
+		total -= seg->num_blocks;
+	}
+	if (!prefetch_seg_count)
+		return 0;
+
+	prefetch_buf = memalign(CACHE_LINE, ROUNDUP(total * dev->card.block_size, CACHE_LINE));
+	if (!prefetch_buf) {
+		prefetch_seg_count = 0;
+		return 1;
+	}
+
+	data = prefetch_buf;
+	for (i = 0; i < prefetch_seg_count; i++) {
+		seg = &prefetch_segs[i];
+		seg->data = data;
+		data += seg->num_blocks * dev->card.block_size;
+
+		arch_clean_invalidate_cache_range((addr_t) seg->data,
+						  seg->num_blocks * dev->card.block_size);
+		if (mmc_sdhci_read(dev, seg->data, seg->blk_addr, seg->num_blocks)) {
+			dprintf(CRITICAL, "Failed to prefetch %u blocks @ %llu\n",
+				seg->num_blocks, seg->blk_addr);
+			seg->num_blocks = 0;
+		}
+	}
+
+	dprintf(SPEW, "Prefetched %u blocks in %u reads\n", total, prefetch_seg_count);
+	prefetch_dev = dev;
+	return 0;
+}
+
+/*
+ * Adaptive bus tuning: the fixed speed modes (HS, DDR50) start at half the
+ * nominal clock, which is then raised in steps while test reads of the first
+ * blocks match. The data timeout is derived from the measured latencies
+ * instead of using the maximum. On bus errors later on, the transfer is
+ * retried with the clock one step lower (or the maximum timeout).
+ */
+#define MMC_TUNE_BLOCKS            64
+#define MMC_TUNE_READS             4
+#define MMC_TUNE_STEPS             4    /* Clock step is 1/4 of the nominal clock */
+#define MMC_TUNE_TIMEOUT_FACTOR    10
+/* Write timeouts of the SD spec, SDXC cards may take longer */
+#define MMC_SD_WRITE_TIMEOUT_US    250000
+#define MMC_SDXC_WRITE_TIMEOUT_US  500000
+/* eMMC: the write timeout is 10x the access time scaled by R2W_FACTOR */
+#define MMC_WRITE_TIMEOUT_FACTOR   10
+
+/*
+ * Function: mmc write timeout
+ * Arg     : mmc device structure
+ * Return  : Worst case write timeout of the card in us
+ * Flow    : SD cards have a fixed write timeout, for eMMC it is derived
+ *           from the access time (TAAC + NSAC) & R2W_FACTOR in the CSD
+ */
+static uint32_t mmc_write_timeout_us(struct mmc_device *dev)
+{
+	struct mmc_card *card = &dev->card;
+	uint64_t ns;
+
+	if (MMC_CARD_SD(card))
+		return card->capacity > 32ULL * 1024 * 1024 * 1024 ?
+			MMC_SDXC_WRITE_TIMEOUT_US : MMC_SD_WRITE_TIMEOUT_US;
+
+	ns = card->csd.taac_ns;
+	if (dev->host.cur_clk_rate)
+		ns += (uint64_t)card->csd.nsac_clk_cycle * 1000000000ULL /
+			  dev->host.cur_clk_rate;
+
+	ns = (ns * MMC_WRITE_TIMEOUT_FACTOR) << card->csd.r2w_factor;
+	return MIN(ns / 1000, UINT32_MAX);
+}
+
+/*
+ * Function: mmc bus fallback
+ * Arg     : mmc device structure & error status of the failed transfer
+ * Return  : true if the transfer should be retried
+ * Flow    : Lower the clock by one step on CRC/end bit errors
+ */
+static bool mmc_bus_fallback(struct mmc_device *dev, uint32_t err)
+{
+	struct sdhci_host *host = &dev->host;
+
+	if (!(err & SDHCI_BUS_ERR_MASK) || !dev->clk_step ||
+		host->cur_clk_rate <= dev->clk_step)
+		return false;
+
+	if (sdhci_change_freq_clk(host, host->cur_clk_rate - dev->clk_step))
+		return false;
+
+	dprintf(CRITICAL, "Bus errors, lowering the clock to %u KHz\n",
+			  host->cur_clk_rate / 1000);
+	return true;
+}
+
+/*
+ * Function: mmc tune read
+ * Arg     : mmc device structure, buffer & worst latency seen so far
+ * Return  : 0 on Success, 1 on Failure
+ * Flow    : Read the test blocks once and track the latency
+ */
+static uint32_t mmc_tune_read(struct mmc_device *dev, void *buf, uint32_t *worst_us)
+{
+	struct mmc_command cmd = {0};
+	struct mmc_card *card = &dev->card;
+	bigtime_t start = current_time_hires();
+	uint32_t us;
+
+	cmd.cmd_index = CMD18_READ_MULTIPLE_BLOCK;
+	cmd.argument = 0;
+	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
+	cmd.resp_type = SDHCI_CMD_RESP_R1;
+	cmd.trans_mode = SDHCI_MMC_READ;
+	cmd.data_present = 0x1;
+	cmd.cmd23_support = MMC_CARD_SD(card) ? card->scr.cmd23_support : 0x1;
+	cmd.data.data_ptr = buf;
+	cmd.data.num_blocks = MMC_TUNE_BLOCKS;
+
+	dma_map(buf, MMC_TUNE_BLOCKS * MMC_BLK_SZ, DMA_FROM_DEVICE);
+
+	if (sdhci_send_command(&dev->host, &cmd)) {
+		mmc_stop_command(dev);
+		return 1;
+	}
+
+	us = current_time_hires() - start;
+	*worst_us = MAX(*worst_us, us);
+
+	return mmc_parse_response(cmd.resp[0]);
+}
+
+/*
+ * Function: mmc tune bus
+ * Arg     : mmc device structure
+ * Return  : None
+ * Flow    : 1. Read reference data at half the nominal clock
+ *           2. Raise the clock step by step while the data matches
+ *           3. Set the data timeout from the worst latency seen
+ */
+static void mmc_tune_bus(struct mmc_device *dev)
+{
+	struct sdhci_host *host = &dev->host;
+	uint32_t size = MMC_TUNE_BLOCKS * MMC_BLK_SZ;
+	uint32_t max_clk = host->cur_clk_rate;
+	uint32_t clk, worst_us = 0, timeout_us;
+	uint8_t *ref, *buf;
+	int i;
+
+	dev->clk_step = 0;
+
+	ref = memalign(CACHE_LINE, 2 * size);
+	if (!ref)
+		return;
+	buf = ref + size;
+
+	/* HS200/HS400 run from the core clock and are tuned separately */
+	if (host->timing == MMC_HS200_TIMING || host->timing == MMC_HS400_TIMING) {
+		if (mmc_tune_read(dev, ref, &worst_us))
+			goto out;
+		goto timeout;
+	}
+
+	dev->clk_step = max_clk / MMC_TUNE_STEPS;
+	clk = max_clk / 2;
+	if (sdhci_change_freq_clk(host, clk) || mmc_tune_read(dev, ref, &worst_us)) {
+		dprintf(CRITICAL, "mmc: Test read failed at %u KHz\n", clk / 1000);
+		goto out;
+	}
+
+	while (clk < max_clk) {
+		clk = MIN(clk + dev->clk_step, max_clk);
+		if (sdhci_change_freq_clk(host, clk))
+			break;
+
+		for (i = 0; i < MMC_TUNE_READS; i++) {
+			if (mmc_tune_read(dev, buf, &worst_us) || memcmp(ref, buf, size))
+				break;
+		}
+
+		if (i < MMC_TUNE_READS) {
+			dprintf(INFO, "mmc: Transfers fail at %u KHz\n", clk / 1000);
+			sdhci_change_freq_clk(host, clk - dev->clk_step);
+			break;
+		}
+	}
+
+timeout:
+	/*
+	 * Writes may take up to 2^R2W_FACTOR times longer than reads, but never
+	 * time out before the card's own write timeout
+	 */
+	timeout_us = worst_us * MMC_TUNE_TIMEOUT_FACTOR << dev->card.csd.r2w_factor;
+	timeout_us = sdhci_set_data_timeout(host, MAX(timeout_us, mmc_write_timeout_us(dev)));
+
+	dprintf(INFO, "mmc: Bus clock %u KHz, worst read %u us, data timeout %u ms\n",
+			host->cur_clk_rate / 1000, worst_us, timeout_us / 1000);
+out:
+	free(ref);
+}
+
+/*
+ * Function: mmc sdhci xfer
+ * Arg     : mmc device structure, data description, block address,
+ *           transfer mode & packed command flag
  * Return  : 0 on Success, non zero on success
- * Flow    : Fill in the command structure & send the command
+ * Flow    : Fill in the command structure for a block read/write &
+ *           send the command
  */
-uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
-						uint64_t blk_addr, uint32_t num_blocks)
+static uint32_t mmc_sdhci_xfer(struct mmc_device *dev, struct mmc_data *data,
+							   uint64_t blk_addr, uint32_t trans_mode, bool packed)
 {
 	uint32_t mmc_ret = 0;
+	uint32_t err;
 	struct mmc_command cmd;
 	struct mmc_card *card = &dev->card;
+	uint32_t num_blocks = data->num_blocks;
 
 	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
 
-	/* CMD17/18 Format:
+	/* CMD17/18/24/25 Format:
 	 * [31:0] Data Address
 	 */
-	if (num_blocks == 1)
-		cmd.cmd_index = CMD17_READ_SINGLE_BLOCK;
+	if (trans_mode == SDHCI_MMC_READ)
+		cmd.cmd_index = (num_blocks == 1) ? CMD17_READ_SINGLE_BLOCK : CMD18_READ_MULTIPLE_BLOCK;
 	else
-		cmd.cmd_index = CMD18_READ_MULTIPLE_BLOCK;
+		cmd.cmd_index = (num_blocks == 1) ? CMD24_WRITE_SINGLE_BLOCK : CMD25_WRITE_MULTIPLE_BLOCK;
 
 	/*
 	 * Standard emmc cards use byte mode addressing
@@ -1979,7 +2430,7 @@ uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
 
 	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
 	cmd.resp_type = SDHCI_CMD_RESP_R1;
-	cmd.trans_mode = SDHCI_MMC_READ;
+	cmd.trans_mode = trans_mode;
 	cmd.data_present = 0x1;
 
 	/* Use CMD23 If card supports CMD23:
@@ -1994,17 +2445,22 @@ uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
 	else
 		cmd.cmd23_support = 0x1;
 
-	cmd.data.data_ptr = dest;
-	cmd.data.num_blocks = num_blocks;
+	cmd.data = *data;
+	cmd.packed = packed;
 
-	/* send command */
-	mmc_ret = sdhci_send_command(&dev->host, &cmd);
+	do {
+		/* send command */
+		mmc_ret = sdhci_send_command(&dev->host, &cmd);
+		err = dev->host.last_err;
 
-	/* For multi block read failures send stop command */
-	if (mmc_ret && num_blocks > 1)
-	{
-		return mmc_stop_command(dev);
-	}
+		/* For multi block read/write failures send stop command */
+		if (mmc_ret && num_blocks > 1 && mmc_stop_command(dev))
+			dprintf(CRITICAL, "Failed to stop the transfer after an error\n");
+	} while (mmc_ret && mmc_bus_fallback(dev, err));
+
+	/* The data is lost even if the card was stopped successfully */
+	if (mmc_ret)
+		return mmc_ret;
 
 	/*
 	 * Response contains 32 bit Card status.
@@ -2013,6 +2469,26 @@ uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
 	return mmc_parse_response(cmd.resp[0]);
 }
 
+/*
+ * Function: mmc sdhci read
+ * Arg     : mmc device structure, block address, number of blocks & destination
+ * Return  : 0 on Success, non zero on success
+ * Flow    : Fill in the command structure & send the command
+ */
+uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
+						uint64_t blk_addr, uint32_t num_blocks)
+{
+	struct mmc_data data = {0};
+
+	if (mmc_prefetch_lookup(dev, dest, blk_addr, num_blocks))
+		return 0;
+
+	data.data_ptr = dest;
+	data.num_blocks = num_blocks;
+
+	return mmc_sdhci_xfer(dev, &data, blk_addr, SDHCI_MMC_READ, false);
+}
+
 /*
  * Function: mmc sdhci write
  * Arg     : mmc device structure, block address, number of blocks & source
@@ -2022,64 +2498,163 @@ uint32_t mmc_sdhci_read(struct mmc_device *dev, void *dest,
 uint32_t mmc_sdhci_write(struct mmc_device *dev, void *src,
 						 uint64_t blk_addr, uint32_t num_blocks)
 {
-	uint32_t mmc_ret = 0;
-	struct mmc_command cmd;
-	struct mmc_card *card = &dev->card;
+	struct mmc_data data = {0};
 
-	memset((struct mmc_command *)&cmd, 0, sizeof(struct mmc_command));
+	mmc_sdhci_prefetch_drop(dev);
 
-	/* CMD24/25 Format:
-	 * [31:0] Data Address
-	 */
+	data.data_ptr = src;
+	data.num_blocks = num_blocks;
 
-	if (num_blocks == 1)
-		cmd.cmd_index = CMD24_WRITE_SINGLE_BLOCK;
-	else
-		cmd.cmd_index = CMD25_WRITE_MULTIPLE_BLOCK;
+	return mmc_sdhci_xfer(dev, &data, blk_addr, SDHCI_MMC_WRITE, false);
+}
 
-	/*
-	 * Standard emmc cards use byte mode addressing
-	 * convert the block address to byte address before
-	 * sending the command
-	 */
-	if (card->type == MMC_TYPE_STD_MMC)
-		cmd.argument = blk_addr * card->block_size;
-	else
-		cmd.argument = blk_addr;
-	cmd.cmd_type = SDHCI_CMD_TYPE_NORMAL;
-	cmd.resp_type = SDHCI_CMD_RESP_R1;
-	cmd.trans_mode = SDHCI_MMC_WRITE;
+/*
+ * Function: mmc sdhci segs blocks
+ * Arg     : Data segments & number of segments
+ * Return  : Total number of blocks, 0 if a segment is not block aligned
+ *           or the total does not fit in one adma transfer
+ */
+static uint32_t mmc_sdhci_segs_blocks(struct mmc_data_seg *segs, uint32_t num_segs)
+{
+	uint64_t len = 0;
+	uint32_t i;
 
-	/* Use CMD23 If card supports CMD23:
-	 * For SD card use the value read from SCR register
-	 * For emmc by default use CMD23.
-	 * Also as per SDCC spec always use CMD23 to stop
-	 * multiblock read/write if UHS (Ultra High Speed) is
-	 * enabled
-	 */
-	if (MMC_CARD_SD(card))
-		cmd.cmd23_support = dev->card.scr.cmd23_support;
-	else
-		cmd.cmd23_support = 0x1;
+	for (i = 0; i < num_segs; i++) {
+		if (!segs[i].len || segs[i].len % SDHCI_MMC_BLK_SZ)
+			return 0;
+		len += segs[i].len;
+	}
 
-	cmd.data_present = 0x1;
-	cmd.data.data_ptr = src;
-	cmd.data.num_blocks = num_blocks;
+	if (len > SDHCI_ADMA_MAX_TRANS_SZ)
+		return 0;
 
-	/* send command */
-	mmc_ret = sdhci_send_command(&dev->host, &cmd);
+	return len / SDHCI_MMC_BLK_SZ;
+}
 
-	/* For multi block write failures send stop command */
-	if (mmc_ret && num_blocks > 1)
-	{
-		return mmc_stop_command(dev);
+/*
+ * Function: mmc sdhci readv
+ * Arg     : mmc device structure, destination segments, number of
+ *           segments & block address
+ * Return  : 0 on Success, non zero on success
+ * Flow    : Read consecutive blocks from the card into scattered
+ *           buffers with a single command, the adma descriptor table
+ *           points directly to the destination segments
+ */
+uint32_t mmc_sdhci_readv(struct mmc_device *dev, struct mmc_data_seg *segs,
+						 uint32_t num_segs, uint64_t blk_addr)
+{
+	struct mmc_data data = {0};
+
+	if (num_segs == 1)
+		return mmc_sdhci_read(dev, segs[0].data_ptr, blk_addr,
+							  segs[0].len / SDHCI_MMC_BLK_SZ);
+
+	data.num_blocks = mmc_sdhci_segs_blocks(segs, num_segs);
+	if (!data.num_blocks)
+		return 1;
+
+	data.segs = segs;
+	data.num_segs = num_segs;
+
+	return mmc_sdhci_xfer(dev, &data, blk_addr, SDHCI_MMC_READ, false);
+}
+
+/*
+ * Function: mmc sdhci writev
+ * Arg     : mmc device structure, source segments, number of segments
+ *           & block address
+ * Return  : 0 on Success, non zero on success
+ * Flow    : Write scattered buffers to consecutive blocks on the card
+ *           with a single command
+ */
+uint32_t mmc_sdhci_writev(struct mmc_device *dev, struct mmc_data_seg *segs,
+						  uint32_t num_segs, uint64_t blk_addr)
+{
+	struct mmc_data data = {0};
+
+	mmc_sdhci_prefetch_drop(dev);
+
+	data.num_blocks = mmc_sdhci_segs_blocks(segs, num_segs);
+	if (!data.num_blocks)
+		return 1;
+
+	data.segs = segs;
+	data.num_segs = num_segs;
+
+	return mmc_sdhci_xfer(dev, &data, blk_addr, SDHCI_MMC_WRITE, false);
+}
+
+/*
+ * Function: mmc sdhci packed write
+ * Arg     : mmc device structure, source segments, block address of
+ *           each segment & number of segments
+ * Return  : 0 on Success, non zero on success
+ * Flow    : Prepare the packed command header describing the individual
+ *           writes & send it together with the data of all writes using
+ *           one CMD23 (packed) + CMD25 sequence
+ */
+uint32_t mmc_sdhci_packed_write(struct mmc_device *dev, struct mmc_data_seg *segs,
+								uint64_t *blk_addrs, uint32_t count)
+{
+	struct mmc_card *card = &dev->card;
+	struct mmc_data_seg *packed_segs;
+	struct mmc_data data = {0};
+	uint32_t *hdr;
+	uint32_t num_blocks;
+	uint32_t ret;
+	uint32_t i;
+
+	if (count < 2 || count > card->max_packed_writes || card->block_size != MMC_PACKED_HDR_SZ)
+		return 1;
+
+	num_blocks = mmc_sdhci_segs_blocks(segs, count);
+	if (!num_blocks || num_blocks + 1 > SDHCI_ADMA_MAX_TRANS_SZ / SDHCI_MMC_BLK_SZ)
+		return 1;
+
+	hdr = memalign(CACHE_LINE, MMC_PACKED_HDR_SZ);
+	packed_segs = malloc((count + 1) * sizeof(*packed_segs));
+	if (!hdr || !packed_segs) {
+		free(hdr);
+		free(packed_segs);
+		return 1;
 	}
 
+	mmc_sdhci_prefetch_drop(dev);
+
 	/*
-	 * Response contains 32 bit Card status.
-	 * Parse the errors & provide relevant information
+	 * Packed header format:
+	 * [0] entries << 16 | read/write << 8 | version
+	 * [2 * n], [2 * n + 1] CMD23 & CMD25 argument of entry n (n >= 1)
 	 */
-	return mmc_parse_response(cmd.resp[0]);
+	memset(hdr, 0, MMC_PACKED_HDR_SZ);
+	hdr[0] = (count << 16) | (MMC_PACKED_CMD_WR << 8) | MMC_PACKED_CMD_VER;
+
+	packed_segs[0].data_ptr = hdr;
+	packed_segs[0].len = MMC_PACKED_HDR_SZ;
+
+	for (i = 0; i < count; i++) {
+		hdr[(i + 1) * 2] = segs[i].len / SDHCI_MMC_BLK_SZ;
+		if (card->type == MMC_TYPE_STD_MMC)
+			hdr[(i + 1) * 2 + 1] = blk_addrs[i] * card->block_size;
+		else
+			hdr[(i + 1) * 2 + 1] = blk_addrs[i];
+
+		packed_segs[i + 1] = segs[i];
+	}
+
+	arch_clean_invalidate_cache_range((addr_t)hdr, MMC_PACKED_HDR_SZ);
+
+	data.segs = packed_segs;
+	data.num_segs = count + 1;
+	data.num_blocks = num_blocks + 1;
+
+	/* The CMD25 argument is the address of the first individual write */
+	ret = mmc_sdhci_xfer(dev, &data, blk_addrs[0], SDHCI_MMC_WRITE, true);
+
+	free(packed_segs);
+	free(hdr);
+
+	return ret;
 }
 
 /*
@@ -2234,6 +2809,8 @@ uint32_t mmc_sdhci_erase(struct mmc_device *dev, uint32_t blk_addr, uint64_t len
 
 	card = &dev->card;
 
+	mmc_sdhci_prefetch_drop(dev);
+
 	/*
 	 * Calculate the erase unit size,
 	 * 1. Based on emmc 4.5 spec for emmc card
@@ -2548,6 +3125,8 @@ uint32_t mmc_sdhci_rpmb_send(struct mmc_device *dev, struct mmc_command *cmd)
 
 	ASSERT(cmd);
 
+	mmc_sdhci_prefetch_drop(dev);
+
 	/* 1. Set the partition type to rpmb */
 	if (mmc_sdhci_switch_part(dev, PART_ACCESS_RPMB))
 		return 1;
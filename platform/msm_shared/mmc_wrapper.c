@@ -28,6 +28,8 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <crc32.h>
+#include <dma.h>
 #include <mmc_wrapper.h>
 #include <mmc_sdhci.h>
 #include <sdhci.h>
@@ -35,6 +37,11 @@
 #include <target.h>
 #include <string.h>
 #include <partition_parser.h>
+#include <platform.h>
+
+/* Data read by mmc_read() so far, to judge the storage performance */
+static uint64_t mmc_read_bytes;
+static bigtime_t mmc_read_time;
 
 /*
  * Weak function for UFS.
@@ -127,7 +134,7 @@ uint32_t mmc_write(uint64_t data_addr, uint32_t data_len, void *in)
 	 * Flush the cache before handing over the data to
 	 * storage driver
 	 */
-	arch_clean_invalidate_cache_range((addr_t)in, data_len);
+	dma_map(in, data_len, DMA_TO_DEVICE);
 
 	if (platform_boot_dev_isemmc())
 	{
@@ -168,6 +175,112 @@ uint32_t mmc_write(uint64_t data_addr, uint32_t data_len, void *in)
 	return val;
 }
 
+/*
+ * Function: mmc_write_queue_init
+ * Arg     : Write queue
+ * Return  : None
+ * Flow    : Prepare an empty write queue
+ */
+void mmc_write_queue_init(struct mmc_write_queue *queue)
+{
+	queue->count = 0;
+	queue->bytes = 0;
+}
+
+/*
+ * Function: mmc_write_queue_flush
+ * Arg     : Write queue
+ * Return  : 0 on Success, non zero on failure
+ * Flow    : Write all queued buffers. If the card supports packed commands
+ *           all writes are sent with a single command, otherwise writes to
+ *           adjacent addresses are combined into one scatter-gather write
+ */
+uint32_t mmc_write_queue_flush(struct mmc_write_queue *queue)
+{
+	struct mmc_device *dev = (struct mmc_device *)target_mmc_device();
+	uint32_t block_size = mmc_get_device_blocksize();
+	uint32_t count = queue->count;
+	uint32_t val = 0;
+	uint32_t i, j;
+	uint64_t end;
+
+	mmc_write_queue_init(queue);
+
+	if (count > 1 && count <= dev->card.max_packed_writes) {
+		uint64_t blk_addrs[MMC_WRITE_QUEUE_MAX_ENTRIES];
+
+		for (i = 0; i < count; i++)
+			blk_addrs[i] = queue->data_addr[i] / block_size;
+
+		if (!mmc_sdhci_packed_write(dev, queue->segs, blk_addrs, count))
+			return 0;
+
+		dprintf(INFO, "Packed write of %u entries failed, writing them one by one\n", count);
+	}
+
+	for (i = 0; i < count; i = j) {
+		end = queue->data_addr[i] + queue->segs[i].len;
+		for (j = i + 1; j < count && queue->data_addr[j] == end; j++)
+			end += queue->segs[j].len;
+
+		val = mmc_sdhci_writev(dev, &queue->segs[i], j - i, queue->data_addr[i] / block_size);
+		if (val) {
+			dprintf(CRITICAL, "Failed Writing block @ %llx\n", queue->data_addr[i] / block_size);
+			return val;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Function: mmc_write_queued
+ * Arg     : Write queue, data address on card, data length, i/p buffer
+ * Return  : 0 on Success, non zero on failure
+ * Flow    : Add a small write to the queue, the buffer must stay valid
+ *           until the queue is flushed. Large writes and writes that
+ *           cannot be batched are written immediately
+ */
+uint32_t mmc_write_queued(struct mmc_write_queue *queue, uint64_t data_addr,
+			  uint32_t data_len, void *in)
+{
+	uint32_t block_size = mmc_get_device_blocksize();
+	uint32_t val;
+
+	if (data_len % block_size)
+		data_len = ROUNDUP(data_len, block_size);
+
+	if (!platform_boot_dev_isemmc() || data_len > MMC_WRITE_QUEUE_MAX_BYTES / 4) {
+		val = mmc_write_queue_flush(queue);
+		if (val)
+			return val;
+		return mmc_write(data_addr, data_len, in);
+	}
+
+	if (queue->count == MMC_WRITE_QUEUE_MAX_ENTRIES ||
+	    queue->bytes + data_len > MMC_WRITE_QUEUE_MAX_BYTES) {
+		val = mmc_write_queue_flush(queue);
+		if (val)
+			return val;
+	}
+
+	ASSERT(!(data_addr % block_size));
+
+	/*
+	 * Flush the cache before handing over the data to
+	 * storage driver
+	 */
+	dma_map(in, data_len, DMA_TO_DEVICE);
+
+	queue->data_addr[queue->count] = data_addr;
+	queue->segs[queue->count].data_ptr = in;
+	queue->segs[queue->count].len = data_len;
+	queue->count++;
+	queue->bytes += data_len;
+
+	return 0;
+}
+
 /*
  * Function: mmc_read
  * Arg     : Data address on card, o/p buffer & data length
@@ -179,6 +292,8 @@ uint32_t mmc_read(uint64_t data_addr, uint32_t *out, uint32_t data_len)
 	uint32_t ret = 0;
 	uint32_t block_size;
 	uint32_t read_size = SDHCI_ADMA_MAX_TRANS_SZ;
+	uint32_t total_len = data_len;
+	bigtime_t start = current_time_hires();
 	void *dev;
 	uint8_t *sptr = (uint8_t *)out;
 
@@ -194,7 +309,7 @@ uint32_t mmc_read(uint64_t data_addr, uint32_t *out, uint32_t data_len)
 	 * write back buffers. Invalidate cache
 	 * before read data from mmc.
          */
-	arch_clean_invalidate_cache_range((addr_t)(out), data_len);
+	dma_map(out, data_len, DMA_FROM_DEVICE);
 
 	if (platform_boot_dev_isemmc())
 	{
@@ -229,12 +344,56 @@ uint32_t mmc_read(uint64_t data_addr, uint32_t *out, uint32_t data_len)
 			dprintf(CRITICAL, "Error: UFS read failed writing to block: %llu\n", data_addr);
 		}
 
-		arch_invalidate_cache_range((addr_t)out, data_len);
+		dma_unmap(out, data_len, DMA_FROM_DEVICE);
+	}
+
+	if (!ret) {
+		mmc_read_bytes += total_len;
+		mmc_read_time += current_time_hires() - start;
 	}
 
 	return ret;
 }
 
+/*
+ * Function: mmc_get_read_stats
+ * Arg     : Output for the bytes read and the time spent (in us)
+ * Return  : None
+ * Flow    : Return the totals of all successful mmc_read() calls
+ */
+void mmc_get_read_stats(uint64_t *bytes, uint64_t *us)
+{
+	*bytes = mmc_read_bytes;
+	*us = mmc_read_time;
+}
+
+
+/*
+ * Function: mmc_prefetch
+ * Arg     : Block ranges on card & number of ranges
+ * Return  : 0 on Success, non zero on failure
+ * Flow    : Read the ranges in one sorted batch, later calls to mmc_read
+ *           for data inside them are served from memory
+ */
+uint32_t mmc_prefetch(struct mmc_prefetch_range *ranges, uint32_t count)
+{
+	if (!platform_boot_dev_isemmc())
+		return 0;
+
+	return mmc_sdhci_prefetch((struct mmc_device *)target_mmc_device(), ranges, count);
+}
+
+/*
+ * Function: mmc_prefetch_drop
+ * Arg     : None
+ * Return  : None
+ * Flow    : Free the data read by mmc_prefetch
+ */
+void mmc_prefetch_drop(void)
+{
+	if (platform_boot_dev_isemmc())
+		mmc_sdhci_prefetch_drop((struct mmc_device *)target_mmc_device());
+}
 
 /*
  * Function: mmc get erase unit size
@@ -308,9 +467,11 @@ static uint32_t mmc_zero_out(struct mmc_device* dev, uint32_t blk_addr, uint32_t
 	while (erase_size > 0) {
 		if (erase_size <= write_size)
 			write_size = erase_size;
+		/* The scratch region may still hold a (clean) download */
+		dma_forget(out, write_size);
 		memset((void *)out, 0, write_size);
 		/* Flush the data to memory before writing to storage */
-		arch_clean_invalidate_cache_range((addr_t) out , write_size);
+		dma_map(out, write_size, DMA_TO_DEVICE);
 		if (mmc_sdhci_write(dev, out, blk_addr , write_size / block_size))
 		{
 			printf(CRITICAL, "failed to erase the partition: %x\n", blk_addr);
@@ -446,6 +607,36 @@ uint32_t mmc_get_psn(void)
 	}
 }
 
+/*
+ * Function: mmc get cid serial
+ * Arg     : None
+ * Return  : Returns a serial number derived from the whole CID
+ * Flow    : The PSN is only unique for one manufacturer/product, so hash it
+ *           together with the other CID fields. Falls back to the PSN for UFS.
+ */
+uint32_t mmc_get_cid_serial(void)
+{
+	struct mmc_card *card;
+	struct mmc_cid *cid;
+	uint32_t crc = ~0U;
+
+	if (!platform_boot_dev_isemmc())
+		return mmc_get_psn();
+
+	card = get_mmc_card();
+	cid = &card->cid;
+
+	crc = crc32(crc, &cid->mid, sizeof(cid->mid));
+	crc = crc32(crc, &cid->oid, sizeof(cid->oid));
+	crc = crc32(crc, cid->pnm, sizeof(cid->pnm));
+	crc = crc32(crc, &cid->prv, sizeof(cid->prv));
+	crc = crc32(crc, &cid->psn, sizeof(cid->psn));
+	crc = crc32(crc, &cid->month, sizeof(cid->month));
+	crc = crc32(crc, &cid->year, sizeof(cid->year));
+
+	return ~crc;
+}
+
 /*
  * Function: mmc get capacity
  * Arg     : None
@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <crc32.h>
+#include <dma.h>
 #include "mmc.h"
 #include "partition_parser.h"
 #define GPT_HEADER_SIZE 92
@@ -759,6 +760,7 @@ static unsigned int write_gpt(uint32_t size, uint8_t *gptImage, uint32_t block_s
 	}
 
 	/* Patching the primary and the backup header of the GPT table */
+	dma_forget(gptImage, size);
 	patch_gpt(gptImage, device_density, partition_entry_array_size,
 		  max_partition_count, partition_entry_size, block_size);
 
@@ -27,6 +27,7 @@
  */
 
 #include <debug.h>
+#include <err.h>
 #include <reg.h>
 #include <compiler.h>
 #include <qtimer.h>
@@ -107,6 +108,45 @@ void udelay(unsigned usecs)
 	delay(ticks);
 }
 
+static status_t __wait_for_cond(const char *name, bool (*cond)(void *arg),
+				void *arg, unsigned timeout_us, unsigned poll_us,
+				int timeout_level)
+{
+	uint64_t start = qtimer_get_phy_timer_cnt();
+	uint64_t timeout = ((uint64_t) timeout_us * ticks_per_sec) / 1000000;
+	uint64_t ticks;
+	status_t ret = NO_ERROR;
+
+	while (!cond(arg)) {
+		ticks = (qtimer_get_phy_timer_cnt() - start) & QTMR_PHY_CNT_MAX_VALUE;
+		if (ticks >= timeout) {
+			/* The condition may have become true while sleeping */
+			if (!cond(arg))
+				ret = ERR_TIMED_OUT;
+			break;
+		}
+		udelay(poll_us);
+	}
+
+	ticks = (qtimer_get_phy_timer_cnt() - start) & QTMR_PHY_CNT_MAX_VALUE;
+	dprintf(ret ? timeout_level : INFO, "%s: %s after %llu us\n", name,
+		ret ? "timed out" : "ready", (ticks * 1000000) / ticks_per_sec);
+
+	return ret;
+}
+
+status_t wait_for_cond(const char *name, bool (*cond)(void *arg), void *arg,
+		       unsigned timeout_us, unsigned poll_us)
+{
+	return __wait_for_cond(name, cond, arg, timeout_us, poll_us, CRITICAL);
+}
+
+status_t wait_for_cond_quiet(const char *name, bool (*cond)(void *arg),
+			     void *arg, unsigned timeout_us, unsigned poll_us)
+{
+	return __wait_for_cond(name, cond, arg, timeout_us, poll_us, SPEW);
+}
+
 /* Return current time in micro seconds */
 bigtime_t current_time_hires(void)
 {
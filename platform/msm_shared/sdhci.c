@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <bits.h>
 #include <debug.h>
+#include <dma.h>
 #include <sdhci.h>
 #include <sdhci_msm.h>
 
@@ -223,7 +224,7 @@ static uint32_t sdhci_stop_sdcc_clk(struct sdhci_host *host)
  * Flow:   : 1. Stop the clock
  *           2. Star the clock with new frequency
  */
-static uint32_t sdhci_change_freq_clk(struct sdhci_host *host, uint32_t clk)
+uint32_t sdhci_change_freq_clk(struct sdhci_host *host, uint32_t clk)
 {
 	if (sdhci_stop_sdcc_clk(host)) {
 		dprintf(CRITICAL, "Error: Card is busy, cannot change frequency\n");
@@ -238,6 +239,36 @@ static uint32_t sdhci_change_freq_clk(struct sdhci_host *host, uint32_t clk)
 	return 0;
 }
 
+/*
+ * Function: sdhci set data timeout
+ * Arg     : Host structure & timeout in us
+ * Return  : Timeout actually used in us, 0 if it cannot be set
+ * Flow:   : 1. Find the smallest counter value covering the timeout
+ *           2. Use it for the following commands
+ * Details : Without a timeout clock in the capabilities the data
+ *           timeout counts card clock cycles.
+ */
+uint32_t sdhci_set_data_timeout(struct sdhci_host *host, uint32_t timeout_us)
+{
+	uint64_t clk_khz = host->caps.timeout_clk_rate;
+	uint64_t cycles;
+	uint8_t val = 0;
+
+	if (!clk_khz)
+		clk_khz = host->cur_clk_rate / 1000;
+	if (!clk_khz)
+		return 0;
+
+	cycles = (uint64_t)timeout_us * clk_khz / 1000;
+	while (val < SDHCI_DATA_TIMEOUT_MAX &&
+	       (1ULL << (SDHCI_DATA_TIMEOUT_SHIFT + val)) < cycles)
+		val++;
+
+	host->data_timeout = val;
+
+	return (1ULL << (SDHCI_DATA_TIMEOUT_SHIFT + val)) * 1000 / clk_khz;
+}
+
 /*
  * Function: sdhci set bus power
  * Arg     : Host structure
@@ -380,6 +411,7 @@ static uint8_t sdhci_cmd_err_status(struct sdhci_host *host)
 	uint32_t err;
 
 	err = REG_READ16(host, SDHCI_ERR_INT_STS_REG);
+	host->last_err = err;
 
 	if (err & SDHCI_CMD_TIMEOUT_MASK) {
 		dprintf(CRITICAL, "Error: Command timeout error\n");
@@ -589,83 +621,70 @@ err:
 
 /*
  * Function: sdhci prep desc table
- * Arg     : Pointer data & length
+ * Arg     : Data segments & number of segments
  * Return  : Pointer to desc table
- * Flow:   : Prepare the adma table as per the sd spec v 3.0
+ * Flow:   : Prepare the adma table as per the sd spec v 3.0, every
+ *           segment is split into descriptor lines of at most
+ *           SDHCI_ADMA_DESC_LINE_SZ bytes
  */
-static struct desc_entry *sdhci_prep_desc_table(void *data, uint32_t len)
+static struct desc_entry *sdhci_prep_desc_table(struct mmc_data_seg *segs, uint32_t num_segs)
 {
 	struct desc_entry *sg_list;
 	uint32_t sg_len = 0;
-	uint32_t remain = 0;
-	uint32_t i;
+	uint32_t len;
+	uint32_t i, j = 0;
 	uint32_t table_len = 0;
+	uint8_t *data;
 
-	if (len <= SDHCI_ADMA_DESC_LINE_SZ) {
-		/* Allocate only one descriptor */
-		sg_list = (struct desc_entry *) memalign(lcm(4, CACHE_LINE), ROUNDUP(sizeof(struct desc_entry), CACHE_LINE));
+	/* Calculate the number of entries in desc table */
+	for (i = 0; i < num_segs; i++)
+		sg_len += (segs[i].len + SDHCI_ADMA_DESC_LINE_SZ - 1) / SDHCI_ADMA_DESC_LINE_SZ;
 
-		if (!sg_list) {
-			dprintf(CRITICAL, "Error allocating memory\n");
-			ASSERT(0);
-		}
-
-		sg_list[0].addr = (uint32_t)data;
-		sg_list[0].len = (len < SDHCI_ADMA_DESC_LINE_SZ) ? len : (SDHCI_ADMA_DESC_LINE_SZ & 0xffff);
-		sg_list[0].tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA
-							  | SDHCI_ADMA_TRANS_END;
-
-		sg_len = 1;
-		table_len = sizeof(struct desc_entry);
-	} else {
-		/* Calculate the number of entries in desc table */
-		sg_len = len / SDHCI_ADMA_DESC_LINE_SZ;
-		remain = len - (sg_len * SDHCI_ADMA_DESC_LINE_SZ);
+	table_len = (sg_len * sizeof(struct desc_entry));
 
-		/* Allocate sg_len + 1 entries if there are remaining bytes at the end */
-		if (remain)
-			sg_len++;
+	sg_list = (struct desc_entry *) memalign(lcm(4, CACHE_LINE), ROUNDUP(table_len, CACHE_LINE));
 
-		table_len = (sg_len * sizeof(struct desc_entry));
-
-		sg_list = (struct desc_entry *) memalign(lcm(4, CACHE_LINE), ROUNDUP(table_len, CACHE_LINE));
+	if (!sg_list) {
+		dprintf(CRITICAL, "Error allocating memory\n");
+		ASSERT(0);
+	}
 
-		if (!sg_list) {
-			dprintf(CRITICAL, "Error allocating memory\n");
-			ASSERT(0);
-		}
+	memset((void *) sg_list, 0, table_len);
 
-		memset((void *) sg_list, 0, table_len);
+	/*
+	 * Prepare sglist in the format:
+	 *  ___________________________________________________
+	 * |Transfer Len | Transfer ATTR | Data Address        |
+	 * | (16 bit)    | (16 bit)      | (32 bit)            |
+	 * |_____________|_______________|_____________________|
+	 */
+	for (i = 0; i < num_segs; i++) {
+		data = segs[i].data_ptr;
+		len = segs[i].len;
 
-		/*
-		 * Prepare sglist in the format:
-		 *  ___________________________________________________
-		 * |Transfer Len | Transfer ATTR | Data Address        |
-		 * | (16 bit)    | (16 bit)      | (32 bit)            |
-		 * |_____________|_______________|_____________________|
-		 */
-		for (i = 0; i < (sg_len - 1); i++) {
-				sg_list[i].addr = (uint32_t)data;
-				/*
-				 * Length attribute is 16 bit value & max transfer size for one
-				 * descriptor line is 65536 bytes, As per SD Spec3.0 'len = 0'
-				 * implies 65536 bytes. Truncate the length to limit to 16 bit
-				 * range.
-				 */
-				sg_list[i].len = (SDHCI_ADMA_DESC_LINE_SZ & 0xffff);
-				sg_list[i].tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA;
+		while (len) {
+			sg_list[j].addr = (uint32_t)data;
+			/*
+			 * Length attribute is 16 bit value & max transfer size for one
+			 * descriptor line is 65536 bytes, As per SD Spec3.0 'len = 0'
+			 * implies 65536 bytes. Truncate the length to limit to 16 bit
+			 * range.
+			 */
+			if (len < SDHCI_ADMA_DESC_LINE_SZ) {
+				sg_list[j].len = len;
+				len = 0;
+			} else {
+				sg_list[j].len = (SDHCI_ADMA_DESC_LINE_SZ & 0xffff);
 				data += SDHCI_ADMA_DESC_LINE_SZ;
 				len -= SDHCI_ADMA_DESC_LINE_SZ;
 			}
-
-			/* Fill the last entry of the table with Valid & End
-			 * attributes
-			 */
-			sg_list[sg_len - 1].addr = (uint32_t)data;
-			sg_list[sg_len - 1].len = (len < SDHCI_ADMA_DESC_LINE_SZ) ? len : (SDHCI_ADMA_DESC_LINE_SZ & 0xffff);
-			sg_list[sg_len - 1].tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA |
-										   SDHCI_ADMA_TRANS_END;
+			sg_list[j].tran_att = SDHCI_ADMA_TRANS_VALID | SDHCI_ADMA_TRANS_DATA;
+			j++;
 		}
+	}
+
+	/* Fill the last entry of the table with Valid & End attributes */
+	sg_list[sg_len - 1].tran_att |= SDHCI_ADMA_TRANS_END;
 
 	arch_clean_invalidate_cache_range((addr_t)sg_list, table_len);
 
@@ -691,12 +710,11 @@ static struct desc_entry *sdhci_adma_transfer(struct sdhci_host *host,
 {
 	uint32_t num_blks = 0;
 	uint32_t sz;
-	void *data;
+	struct mmc_data_seg seg;
 	struct desc_entry *adma_addr;
 
 
 	num_blks = cmd->data.num_blocks;
-	data = cmd->data.data_ptr;
 
 	/*
 	 * Some commands send data on DAT lines which is less
@@ -712,7 +730,13 @@ static struct desc_entry *sdhci_adma_transfer(struct sdhci_host *host,
 		sz = num_blks * SDHCI_MMC_BLK_SZ;
 
 	/* Prepare adma descriptor table */
-	adma_addr = sdhci_prep_desc_table(data, sz);
+	if (cmd->data.segs) {
+		adma_addr = sdhci_prep_desc_table(cmd->data.segs, cmd->data.num_segs);
+	} else {
+		seg.data_ptr = cmd->data.data_ptr;
+		seg.len = sz;
+		adma_addr = sdhci_prep_desc_table(&seg, 1);
+	}
 
 	/* Write adma address to adma register */
 	REG_WRITE32(host, (uint32_t) adma_addr, SDHCI_ADM_ADDR_REG);
@@ -748,13 +772,16 @@ uint32_t sdhci_send_command(struct sdhci_host *host, struct mmc_command *cmd)
 	uint16_t trans_mode = 0;
 	uint16_t present_state;
 	uint32_t flags;
+	uint32_t i;
 	struct desc_entry *sg_list = NULL;
 
 	DBG("\n %s: START: cmd:%04d, arg:0x%08x, resp_type:0x%04x, data_present:%d\n",
 				__func__, cmd->cmd_index, cmd->argument, cmd->resp_type, cmd->data_present);
 
 	if (cmd->data_present)
-		ASSERT(cmd->data.data_ptr);
+		ASSERT(cmd->data.data_ptr || cmd->data.segs);
+
+	host->last_err = 0;
 
 	/*
 	 * Assert if the data buffer is not aligned to cache
@@ -839,8 +866,13 @@ uint32_t sdhci_send_command(struct sdhci_host *host, struct mmc_command *cmd)
 			break;
 	};
 
-	/* Set the timeout value */
-	REG_WRITE8(host, SDHCI_CMD_TIMEOUT, SDHCI_TIMEOUT_REG);
+	/*
+	 * Set the timeout value, the tuned data timeout only covers transfers.
+	 * Busy waits of commands without data (R1B of erase & switch) keep
+	 * the maximum timeout.
+	 */
+	REG_WRITE8(host, cmd->data_present ? host->data_timeout : SDHCI_CMD_TIMEOUT,
+		   SDHCI_TIMEOUT_REG);
 
 	/* Check if data needs to be processed */
 	if (cmd->data_present)
@@ -871,7 +903,8 @@ uint32_t sdhci_send_command(struct sdhci_host *host, struct mmc_command *cmd)
 		if ((cmd->data.num_blocks > 1) && !cmd->rel_write) {
 			if (cmd->cmd23_support) {
 				trans_mode |= SDHCI_TRANS_MULTI | SDHCI_AUTO_CMD23_EN | SDHCI_BLK_CNT_EN;
-				REG_WRITE32(host, cmd->data.num_blocks, SDHCI_ARG2_REG);
+				REG_WRITE32(host, cmd->data.num_blocks | (cmd->packed ? SDHCI_CMD23_PACKED : 0),
+							SDHCI_ARG2_REG);
 			}
 			else
 				trans_mode |= SDHCI_TRANS_MULTI | SDHCI_AUTO_CMD12_EN | SDHCI_BLK_CNT_EN;
@@ -895,8 +928,11 @@ uint32_t sdhci_send_command(struct sdhci_host *host, struct mmc_command *cmd)
 	}
 
 	/* Invalidate the cache only for read operations */
-	if (cmd->trans_mode == SDHCI_MMC_READ)
-		arch_invalidate_cache_range((addr_t)cmd->data.data_ptr, (cmd->data.num_blocks * SDHCI_MMC_BLK_SZ));
+	if (cmd->trans_mode == SDHCI_MMC_READ && cmd->data.segs) {
+		for (i = 0; i < cmd->data.num_segs; i++)
+			dma_unmap(cmd->data.segs[i].data_ptr, cmd->data.segs[i].len, DMA_FROM_DEVICE);
+	} else if (cmd->trans_mode == SDHCI_MMC_READ)
+		dma_unmap(cmd->data.data_ptr, (cmd->data.num_blocks * SDHCI_MMC_BLK_SZ), DMA_FROM_DEVICE);
 
 	DBG("\n %s: END: cmd:%04d, arg:0x%08x, resp:0x%08x 0x%08x 0x%08x 0x%08x\n",
 				__func__, cmd->cmd_index, cmd->argument, cmd->resp[0], cmd->resp[1], cmd->resp[2], cmd->resp[3]);
@@ -935,6 +971,15 @@ void sdhci_init(struct sdhci_host *host)
 	host->caps.base_clk_rate = (caps[0] & SDHCI_CLK_RATE_MASK) >> SDHCI_CLK_RATE_BIT;
 	host->caps.base_clk_rate *= 1000000;
 
+	/* Data timeout clock, 0 if not specified */
+	host->caps.timeout_clk_rate = caps[0] & SDHCI_TIMEOUT_CLK_MASK;
+	if (caps[0] & SDHCI_TIMEOUT_CLK_UNIT_MHZ)
+		host->caps.timeout_clk_rate *= 1000;
+
+	/* Use the longest timeout until the card was measured */
+	host->data_timeout = SDHCI_CMD_TIMEOUT;
+	host->last_err = 0;
+
 	/* Get the max block length for mmc */
 	host->caps.max_blk_len = (caps[0] & SDHCI_BLK_LEN_MASK) >> SDHCI_BLK_LEN_BIT;
 
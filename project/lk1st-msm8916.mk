@@ -10,3 +10,8 @@ GPIO_I2C_BUS_COUNT := 1
 
 # Memory usually reserved for RMTFS, should be fine for early SMP bring-up
 SMP_SPIN_TABLE_BASE := 0x86700000
+
+# Unused memory between lk and the fastboot download buffer (SCRATCH_ADDR),
+# used to draw the display contents off-screen before flipping them on screen
+DISPLAY_BACK_BUFFER_BASE := 0x8F700000
+DISPLAY_BACK_BUFFER_SIZE := 0x00A00000
@@ -67,6 +67,12 @@ __WEAK unsigned target_get_max_flash_size(void)
     return (120 * 1024 * 1024);
 }
 
+/* Apply SD card insertion/removal, returns true if the card changed */
+__WEAK bool target_sdcard_update(void)
+{
+    return false;
+}
+
 __WEAK int flash_ubi_img(void)
 {
     return 0;
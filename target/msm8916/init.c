@@ -33,6 +33,7 @@
 #include <platform.h>
 #include <uart_dm.h>
 #include <mmc.h>
+#include <sdhci_msm.h>
 #include <platform/gpio.h>
 #include <dev/keys.h>
 #include <spmi_v2.h>
@@ -53,6 +54,10 @@
 #include <rpmb.h>
 #include <smem.h>
 #include <lk2nd.h>
+#include <lib/bio.h>
+#include <lib/partition.h>
+#include <kernel/timer.h>
+#include <platform/timer.h>
 
 #if LONG_PRESS_POWER_ON
 #include <shutdown_detect.h>
@@ -110,10 +115,141 @@ void target_early_init(void)
 #endif
 }
 
+static void target_sdcard_init(void)
+{
+	struct mmc_config_data sd_config;
+
+	dprintf(SPEW, "initialising mmc_slot =%u\n", 2);
+
+	sd_config.bus_width    = DATA_BUS_WIDTH_4BIT;
+	sd_config.slot         = 2;
+	sd_config.max_clk_rate = MMC_CLK_200MHZ;
+	sd_config.sdhc_base    = mmc_sdhci_base[sd_config.slot - 1];
+	sd_config.pwrctl_base  = mmc_pwrctl_base[sd_config.slot - 1];
+	sd_config.pwr_irq      = mmc_sdc_pwrctl_irq[sd_config.slot - 1];
+	sd_config.hs400_support = 0;
+
+	/* Set drive strength & pull ctrl values */
+	set_sdc_power_ctrl(sd_config.slot);
+
+	sdcard_dev = mmc_init(&sd_config);
+
+	if (!sdcard_dev) {
+		dprintf(CRITICAL, "sdcard init failed!");
+	} else if (!dev) {
+		/* emmc failed but we still have sdcard */
+		dev = sdcard_dev;
+	}
+}
+
+#if WITH_LK2ND
+/*
+ * SD card detect: If the lk2nd device node has a card detect GPIO, the SD
+ * card is only initialized if a card is present. Insertion and removal are
+ * tracked by a debounced poll timer and applied lazily (in thread context)
+ * when fs-boot looks at the SD card the next time.
+ */
+#define SD_CD_POLL_MS		50
+#define SD_CD_DEBOUNCE		4	/* stable polls before accepting a change */
+
+static int sd_cd_gpio = -1;
+static uint8_t sd_cd_active;
+static timer_t sd_cd_timer;
+static bool sd_cd_last;
+static unsigned sd_cd_stable;
+static volatile bool sd_cd_present;
+static struct mmc_device *sd_cd_dev;	/* reused when a card is inserted again */
+
+static bool sd_cd_read(void)
+{
+	return gpio_status(sd_cd_gpio) == sd_cd_active;
+}
+
+static enum handler_return sd_cd_poll(struct timer *t, time_t now, void *arg)
+{
+	bool present = sd_cd_read();
+
+	if (present != sd_cd_last) {
+		sd_cd_last = present;
+		sd_cd_stable = 0;
+	} else if (sd_cd_stable < SD_CD_DEBOUNCE && ++sd_cd_stable == SD_CD_DEBOUNCE) {
+		sd_cd_present = present;
+	}
+
+	return INT_NO_RESCHEDULE;
+}
+
+/* Returns false if the SD card init should be skipped */
+static bool sd_cd_init(void)
+{
+	uint8_t pull;
+
+	sd_cd_gpio = lk2nd_fdt_parse_sd_cd_gpio(&pull, &sd_cd_active);
+	if (sd_cd_gpio < 0)
+		return true;
+
+	gpio_tlmm_config(sd_cd_gpio, 0, GPIO_INPUT, pull, GPIO_2MA, GPIO_ENABLE);
+	/* Let the pull settle */
+	udelay(1000);
+
+	sd_cd_last = sd_cd_present = sd_cd_read();
+	sd_cd_stable = SD_CD_DEBOUNCE;
+
+	timer_initialize(&sd_cd_timer);
+	timer_set_periodic(&sd_cd_timer, SD_CD_POLL_MS, sd_cd_poll, NULL);
+
+	if (!sd_cd_present)
+		dprintf(INFO, "No SD card detected, skipping init\n");
+	return sd_cd_present;
+}
+
+static void sd_cd_remove(void)
+{
+	bdev_t *bdev;
+
+	dprintf(INFO, "SD card removed\n");
+
+	partition_unpublish("hd2");
+	bdev = bio_open("hd2");
+	if (bdev) {
+		bio_unregister_device(bdev);
+		bio_close(bdev);
+	}
+
+	/*
+	 * The mmc_device is still referenced by the power IRQ handler,
+	 * so it is not freed. mmc_reinit() reuses it on the next insert.
+	 */
+	sdhci_mode_disable(&sdcard_dev->host);
+	sd_cd_dev = sdcard_dev;
+	sdcard_dev = NULL;
+}
+
+bool target_sdcard_update(void)
+{
+	bool present = sd_cd_present;
+
+	/* Without a card detect GPIO (or eMMC) there is nothing to update */
+	if (sd_cd_gpio < 0 || !emmc_dev || present == !!sdcard_dev)
+		return false;
+
+	if (present) {
+		dprintf(INFO, "SD card inserted\n");
+		if (sd_cd_dev)
+			sdcard_dev = mmc_reinit(sd_cd_dev);
+		else
+			target_sdcard_init();
+	} else {
+		sd_cd_remove();
+	}
+
+	return true;
+}
+#endif
+
 void target_sdc_init()
 {
 	struct mmc_config_data config;
-	struct mmc_config_data sd_config;
 
 #ifndef FORCE_SDCARD
 	/* Try slot 1*/
@@ -137,27 +273,10 @@ void target_sdc_init()
 	}
 #endif
 
-	dprintf(SPEW, "initialising mmc_slot =%u\n", 2);
-
-	sd_config.bus_width    = DATA_BUS_WIDTH_4BIT;
-	sd_config.slot         = 2;
-	sd_config.max_clk_rate = MMC_CLK_200MHZ;
-	sd_config.sdhc_base    = mmc_sdhci_base[sd_config.slot - 1];
-	sd_config.pwrctl_base  = mmc_pwrctl_base[sd_config.slot - 1];
-	sd_config.pwr_irq      = mmc_sdc_pwrctl_irq[sd_config.slot - 1];
-	sd_config.hs400_support = 0;
-
-	/* Set drive strength & pull ctrl values */
-	set_sdc_power_ctrl(sd_config.slot);
-
-	sdcard_dev = mmc_init(&sd_config);
-
-	if (!sdcard_dev) {
-		dprintf(CRITICAL, "sdcard init failed!");
-	} else if (!dev) {
-		/* emmc failed but we still have sdcard */
-		dev = sdcard_dev;
-	}
+#if WITH_LK2ND
+	if (sd_cd_init())
+#endif
+		target_sdcard_init();
 
 	if (!sdcard_dev && !emmc_dev) {
 		dprintf(CRITICAL, "BOTH SLOTS FAILED!");
@@ -308,7 +427,12 @@ void target_serialno(unsigned char *buf)
 {
 	uint32_t serialno;
 	if (target_is_emmc_boot()) {
+#if LK2ND_CID_SERIAL
+		/* Unique across eMMC vendors, for hosts flashing many devices */
+		serialno = mmc_get_cid_serial();
+#else
 		serialno = mmc_get_psn();
+#endif
 		snprintf((char *)buf, 13, "%x", serialno);
 	}
 }
@@ -526,6 +650,11 @@ void target_uninit(void)
 		sdhci_mode_disable(&sdcard_dev->host);
 	}
 
+#if WITH_LK2ND
+	if (sd_cd_gpio >= 0)
+		timer_cancel(&sd_cd_timer);
+#endif
+
 	if (crypto_initialized())
 		crypto_eng_cleanup();
 
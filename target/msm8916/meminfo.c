@@ -34,6 +34,9 @@
 #include <libfdt.h>
 #include <platform/iomap.h>
 #include <dev_tree.h>
+#include <lk2nd.h>
+#include <platform.h>
+#include <stdlib.h>
 
 uint32_t target_dev_tree_mem(void *fdt, uint32_t memory_node_offset)
 {
@@ -79,8 +82,72 @@ void *target_get_scratch_address(void)
 	return ((void *)SCRATCH_ADDR);
 }
 
+/* Fallback if the RAM partition table does not cover the scratch region */
+#define DEFAULT_MAX_FLASH_SIZE	(192 * 1024 * 1024)
+/* Keep the download buffer within the 32-bit address space */
+#define MAX_FLASH_END		0xFFF00000ULL
+
+/* End of the usable RAM partition that contains the scratch region */
+static uint64_t target_scratch_ram_end(void)
+{
+	static uint64_t ram_end;
+	ram_partition ptn_entry;
+	unsigned int index, len;
+
+	if (ram_end)
+		return ram_end;
+
+	if (!smem_ram_ptable_init_v1())
+		return 0;
+
+	len = smem_get_ram_ptable_len();
+	for (index = 0; index < len; index++) {
+		smem_get_ram_ptable_entry(&ptn_entry, index);
+
+		if (ptn_entry.category != SDRAM || ptn_entry.type != SYS_MEMORY)
+			continue;
+
+		if (SCRATCH_ADDR >= ptn_entry.start &&
+		    SCRATCH_ADDR < ptn_entry.start + ptn_entry.size) {
+			ram_end = MIN(ptn_entry.start + ptn_entry.size, MAX_FLASH_END);
+			break;
+		}
+	}
+
+	/* Stop at carve-outs placed inside the partition */
+	for (index = 0; ram_end && index < len; index++) {
+		smem_get_ram_ptable_entry(&ptn_entry, index);
+
+		if (ptn_entry.category == SDRAM && ptn_entry.type == SYS_MEMORY)
+			continue;
+
+		if (ptn_entry.start + ptn_entry.size > SCRATCH_ADDR &&
+		    ptn_entry.start < ram_end)
+			ram_end = MAX(ptn_entry.start, SCRATCH_ADDR);
+	}
+
+	return ram_end;
+}
+
+/*
+ * Use all RAM from the scratch region up to the end of its RAM partition
+ * (or the first carve-out, reserved region or region lk2nd still needs)
+ * as download buffer. This used to
+ * be a fixed 192 MiB, because 256 MiB does not fit on 512 MiB devices.
+ */
 unsigned target_get_max_flash_size(void)
 {
-	// 256 MiB breaks some low-memory devices, 192 MiB should be sufficient.
-	return (192 * 1024 * 1024);
+	uint64_t end = target_scratch_ram_end();
+	unsigned size;
+
+	if (end <= SCRATCH_ADDR)
+		return DEFAULT_MAX_FLASH_SIZE;
+
+#if WITH_LK2ND
+	end = lk2nd_mem_limit(SCRATCH_ADDR, end);
+#endif
+
+	size = ROUNDDOWN(end - SCRATCH_ADDR, 1024 * 1024);
+	platform_map_scratch(size);
+	return size;
 }
@@ -93,6 +93,11 @@ static int hyp_test()
 	return scm_call2(&scm_arg, NULL);
 }
 
+void qhypstub_set_state_aarch32(void)
+{
+	hyp_call(QHYPSTUB_STATE_CALL, QHYPSTUB_STATE_AARCH32);
+}
+
 void qhypstub_set_state_aarch64(void)
 {
 	hyp_call(QHYPSTUB_STATE_CALL, QHYPSTUB_STATE_AARCH64);
@@ -637,6 +637,11 @@ void target_display_init(const char *panel_name)
 		return;
 	}
 
+	/*
+	 * The panel is powered on synchronously: doing it in the background
+	 * would run the clock, regulator, GPIO and I2C code concurrently with
+	 * the rest of boot, and none of these paths are serialized.
+	 */
 	do {
 		target_force_cont_splash_disable(false);
 		ret = gcdb_display_init(panel_name, MDP_REV_50, MIPI_FB_ADDR);
@@ -491,7 +491,12 @@ void target_serialno(unsigned char *buf)
 {
 	unsigned int serialno;
 	if (target_is_emmc_boot()) {
+#if LK2ND_CID_SERIAL
+		/* Unique across eMMC vendors, for hosts flashing many devices */
+		serialno = mmc_get_cid_serial();
+#else
 		serialno = mmc_get_psn();
+#endif
 		snprintf((char *)buf, 13, "%x", serialno);
 	}
 }